@@ -6,6 +6,191 @@
 #include <time.h>
 
 #include "../IoTSASTokenGenerateNoMalloc/heap.h"
+#include "../IoTSASTokenGenerateNoMalloc/MultiHeap.h"
+
+int testMultiHeapThreads(void);	// MultiHeapTest.cpp
+
+// Aligned blocks must be aligned, leave their padding free and coalesce
+// back into one free block whatever order they are freed in. Returns the
+// number of failures.
+static int testAligned()
+{
+	static const size_t aligns[] = { 4, 8, 16, 32, 64 };
+	uint16_t buffer[1024];
+	HEAPHANDLE h = heapInit((uint8_t*)(buffer + 1), sizeof(buffer) - 2);	// Offset so the heap start is not aligned
+	HEAPINFO empty;
+	HEAPINFO info;
+	void* ptrs[10];
+	int failed = 0;
+
+	heapGetInfo(h, &empty);
+
+	for (int order = 0; order < 2; order++)
+	{
+		int used = 0;
+
+		for (size_t i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++)
+		{
+			size_t align = aligns[i % (sizeof(aligns) / sizeof(aligns[0]))];
+			size_t len = i * 7 + 3;
+
+			ptrs[i] = (i % 3 == 2) ? heapMalloc(h, len) : heapMallocAligned(h, len, align);
+
+			if (ptrs[i] == NULL || (i % 3 != 2 && ((uintptr_t)ptrs[i] & (align - 1)) != 0))
+			{
+				printf("FAILED: %d byte block aligned to %d at %p\n", (int)len, (int)align, ptrs[i]);
+				failed++;
+				continue;
+			}
+
+			memset(ptrs[i], (int)i, len);
+			used += (int)(len + 1) & ~1;
+		}
+
+		heapGetInfo(h, &info);
+
+		if (info.usedBytes != used)
+		{
+			printf("FAILED: %d bytes used for %d allocated\n", info.usedBytes, used);
+			failed++;
+		}
+
+		for (size_t i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++)
+		{
+			size_t j = order == 0 ? i : sizeof(ptrs) / sizeof(ptrs[0]) - 1 - i;
+
+			if (ptrs[j] != NULL && ((uint8_t*)ptrs[j])[0] != (uint8_t)j)
+			{
+				printf("FAILED: block %d overwritten\n", (int)j);
+				failed++;
+			}
+
+			heapFree(h, ptrs[j]);
+		}
+
+		heapGetInfo(h, &info);
+
+		if (info.largestFree != empty.largestFree)
+		{
+			printf("FAILED: largest free block %d after freeing, %d when empty\n", info.largestFree, empty.largestFree);
+			failed++;
+		}
+	}
+
+	printf("%s: aligned allocations\n", failed == 0 ? "passed" : "FAILED");
+
+	return failed;
+}
+
+// A block freed by another heap's owner stays allocated until its own owner
+// next calls in, then goes back exactly as a local free would. Returns the
+// number of failures.
+static int testMultiHeap()
+{
+	static uint8_t buffer[8192];
+	MULTIHEAPHANDLE h = multiHeapInit(buffer, sizeof(buffer), 2);
+	HEAPINFO empty;
+	HEAPINFO info;
+	int failed = 0;
+
+	heapGetInfo(multiHeapGetHeap(h, 0), &empty);
+
+	void* p1 = multiHeapMalloc(h, 0, 100);
+	void* p2 = multiHeapMalloc(h, 0, 30);
+	void* p3 = multiHeapMalloc(h, 1, 50);
+
+	if (multiHeapGetOwner(h, p1) != 0 || multiHeapGetOwner(h, p2) != 0 || multiHeapGetOwner(h, p3) != 1 || multiHeapGetOwner(h, buffer) != -1)
+	{
+		printf("FAILED: wrong owners\n");
+		failed++;
+	}
+
+	multiHeapFree(h, 1, p1);
+	multiHeapFree(h, 1, p2);
+	multiHeapFree(h, 1, p3);
+	heapGetInfo(multiHeapGetHeap(h, 0), &info);
+
+	if (info.usedBytes != 130)
+	{
+		printf("FAILED: %d bytes used before the owner collects, expected 130\n", info.usedBytes);
+		failed++;
+	}
+
+	multiHeapCollect(h, 0);
+	heapGetInfo(multiHeapGetHeap(h, 0), &info);
+
+	if (info.usedBytes != 0 || info.largestFree != empty.largestFree)
+	{
+		printf("FAILED: %d bytes used and largest free block %d after collecting\n", info.usedBytes, info.largestFree);
+		failed++;
+	}
+
+	multiHeapGetInfo(h, 1, &info);
+
+	if (info.usedBytes != 0)
+	{
+		printf("FAILED: %d bytes used in heap 1\n", info.usedBytes);
+		failed++;
+	}
+
+	printf("%s: multi heap remote frees\n", failed == 0 ? "passed" : "FAILED");
+
+	return failed;
+}
+
+#ifdef _DEBUG_HEAP_INCREMENTAL
+static int corruptions = 0;
+
+// Count reports instead of aborting
+static void countCorruption(HEAPHANDLE hHeap, uint16_t offset, const char* reason)
+{
+	(void)hHeap;
+
+	printf("corruption at offset %d: %s\n", offset, reason);
+	corruptions++;
+}
+
+// Overrun a block by one byte and check the next call on it notices.
+// Returns the number of failures.
+static int testOverrun()
+{
+	uint8_t buffer[512];
+	HEAPHANDLE h = heapInit(buffer, sizeof(buffer));
+	int failed = 0;
+
+	heapSetCorruptionHandler(countCorruption);
+
+	void* p1 = heapMalloc(h, 16);
+	void* p2 = heapMalloc(h, 16);
+
+	if (heapCheck(h) != 0 || corruptions != 0)
+	{
+		printf("FAILED: clean heap reported corrupt\n");
+		failed++;
+	}
+
+	memset(p1, 'X', 17);
+	heapFree(h, p1);
+
+	printf("%s: overrun %s\n", corruptions != 0 ? "passed" : "FAILED", corruptions != 0 ? "reported" : "missed");
+
+	if (corruptions == 0)
+		failed++;
+
+	corruptions = 0;
+
+	if (heapCheck(h) == 0)
+	{
+		printf("FAILED: heapCheck missed the overrun\n");
+		failed++;
+	}
+
+	heapSetCorruptionHandler(NULL);
+	(void)p2;
+
+	return failed;
+}
+#endif
 
 int main()
 {
@@ -97,6 +282,24 @@ int main()
 		}
 	}
 
+	int failures = testAligned();
+
+	failures += testMultiHeap();
+	failures += testMultiHeapThreads();
+
+#ifdef _DEBUG_HEAP_INCREMENTAL
+	if (heapCheck(h) != 0)
+	{
+		printf("FAILED: heap corrupt after the random test\n");
+		failures++;
+	}
+
+	failures += testOverrun();
+#endif
+
 	printf("Done\n");
+
+	// Non zero so a build or script running the tests sees a failure
+	return failures == 0 ? 0 : 1;
 }
 
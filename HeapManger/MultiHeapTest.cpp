@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../IoTSASTokenGenerateNoMalloc/MultiHeap.h"
+
+#define STRESS_THREADS 4
+#define STRESS_SLOTS 64				// Blocks in flight between threads
+#define STRESS_ITERATIONS 200000
+
+static uint8_t stressBuffer[40000];
+static std::atomic<void*> stressSlots[STRESS_SLOTS];
+
+// Each thread keeps allocating from its own heap and swaps the block into a
+// random shared slot. Whatever it gets back, usually another heap's block,
+// it checks and frees, so owners allocate while their blocks are being
+// queued for them from other threads.
+static void stressThread(MULTIHEAPHANDLE h, int heap, std::atomic<int>* failures)
+{
+	uint32_t random = (uint32_t)heap * 7919 + 1;
+
+	for (int i = 0; i < STRESS_ITERATIONS; i++)
+	{
+		random = random * 1103515245 + 12345;
+
+		size_t len = (random >> 8) % 200 + 2;
+		uint8_t* p = (uint8_t*)(((random >> 20) % 4 == 0) ? multiHeapMallocAligned(h, heap, len, 32) : multiHeapMalloc(h, heap, len));
+
+		if (p == NULL)
+			continue;
+
+		memset(p, heap + 1, len);
+		p[0] = (uint8_t)len;
+
+		uint8_t* q = (uint8_t*)stressSlots[(random >> 12) % STRESS_SLOTS].exchange(p);
+
+		if (q != NULL)
+		{
+			int owner = multiHeapGetOwner(h, q);
+
+			for (size_t k = 1; k < q[0]; k++)
+			{
+				if (q[k] != owner + 1)
+				{
+					(*failures)++;
+					break;
+				}
+			}
+
+			multiHeapFree(h, heap, q);
+		}
+	}
+}
+
+// Cross thread frees under load. Returns the number of failures.
+extern "C" int testMultiHeapThreads()
+{
+	MULTIHEAPHANDLE h = multiHeapInit(stressBuffer, sizeof(stressBuffer), STRESS_THREADS);
+	HEAPINFO empty[STRESS_THREADS];
+	std::atomic<int> failures(0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < STRESS_THREADS; i++)
+		heapGetInfo(multiHeapGetHeap(h, i), &empty[i]);
+
+	for (int i = 0; i < STRESS_THREADS; i++)
+		threads.emplace_back(stressThread, h, i, &failures);
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	if (failures != 0)
+		printf("FAILED: %d blocks overwritten while in flight\n", failures.load());
+
+	for (int i = 0; i < STRESS_SLOTS; i++)
+		multiHeapFree(h, 0, stressSlots[i].exchange(nullptr));
+
+	for (int i = 0; i < STRESS_THREADS; i++)
+	{
+		HEAPINFO info;
+
+		multiHeapGetInfo(h, i, &info);
+
+		if (info.usedBytes != 0 || info.largestFree != empty[i].largestFree)
+		{
+			printf("FAILED: heap %d has %d bytes used and largest free block %d, %d when empty\n", i, info.usedBytes, info.largestFree, empty[i].largestFree);
+			failures++;
+		}
+	}
+
+	printf("%s: multi heap cross thread frees\n", failures == 0 ? "passed" : "FAILED");
+
+	return failures;
+}
@@ -1,23 +1,60 @@
 #include "stdafx.h"
 
 #include <algorithm>
-#include <time.h>
 
-#include "sha256.h"
 #include "ConnectionStringHelper.h"
 
-//#define _TESTING
-
-const std::string ConnectionStringHelper::CODES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
-
 /*
  * Constructor
  * 
  *  connectionString          Azure IoT hub device connection string
+ *  resource                  Memory resource for all storage and returned strings
  */
-ConnectionStringHelper::ConnectionStringHelper(const std::string connectionString)
+ConnectionStringHelper::ConnectionStringHelper(std::string_view connectionString, std::pmr::memory_resource *resource)
+	: _resource(resource), keyValue(resource), _encodedUri(resource), _keyed(), _keyValid(false)
 {
 	_tokenCount = findTokens(connectionString);
+	_deviceId = keywordView("deviceid").data();
+	_cacheKey = TokenCache::makeKey(getKeywordValue("hostname"), getKeywordValue("deviceid"), getKeywordValue("moduleid"), getKeywordValue("SharedAccessKey"));
+
+	// Everything generatePassword needs that does not change between tokens
+	{
+		SAS_PROFILE_STAGE(UriBuild);
+
+		std::pmr::string uri(getKeywordValue("hostname"), _resource);
+
+		uri += "/devices/";
+		uri += getKeywordValue("deviceid");
+		_encodedUri = urlEncode(uri, _resource);
+		_uriResource = sas::EncodedResource{ _encodedUri };
+	}
+
+#ifdef _DEBUG
+	printf("URL encoded >%s<\r\n\n", _encodedUri.c_str());
+#endif
+
+	std::pmr::string sharedAccessKey = getKeywordValue("SharedAccessKey");
+
+	SAS_PROFILE_STAGE(KeyDecode);
+
+	size_t keyLen = decodeBase64(sharedAccessKey, NULL, 0);
+
+	if (keyLen != (size_t)-1 && keyLen != 0)
+	{
+		std::pmr::vector<uint8_t> key(keyLen, _resource);
+
+		decodeBase64(sharedAccessKey, key.data(), keyLen);
+
+#ifdef _DEBUG
+		printf("Decoded SharedAccessKey\r\n");
+		dumpBuffer(key.data(), keyLen);
+		printf("\r\n");
+#endif
+
+		// The key never changes so its pads are hashed here rather than per token
+		sas::hmacSha256Init(_keyed, key.data(), keyLen);
+		_keyValid = true;
+	}
 }
 
 /*
@@ -35,223 +72,180 @@ ConnectionStringHelper::~ConnectionStringHelper()
  *  
  *  Returns the keyword value or and empty string if not found
  */
-const std::string ConnectionStringHelper::getKeywordValue(const std::string keywordIn)
+std::pmr::string ConnectionStringHelper::getKeywordValue(std::string_view keyword)
 {
-	std::string keyword = keywordIn;
+	SAS_PROFILE_STAGE(KeywordLookup);
 
-	std::transform(keyword.begin(), keyword.end(), keyword.begin(), ::tolower);
+	TKeyValue::const_iterator it = keyValue.find(keyword);
 
-	if (keyValue.find(keyword) == keyValue.end())
-		return "";
+	if (it == keyValue.end())
+		return std::pmr::string(_resource);
 	else
-		return keyValue[keyword];
+		return std::pmr::string(it->second, _resource);
 }
 
 //
-// Encode string for URL
-string ConnectionStringHelper::urlEncode(const string url)
+// Encode string for URL into a caller supplied buffer
+ptrdiff_t ConnectionStringHelper::urlEncode(std::string_view url, std::span<char> out)
 {
-	static const char *hex = "0123456789ABCDEF";
-	static const string specials = "-._";
-  
-	string result = "";
+	size_t required = sas::urlEncodedLength(url);
 
-	for (uint8_t i = 0; i < url.length(); i++)
+	if (required <= out.size())
 	{
-		if (('a' <= url[i] && url[i] <= 'z') ||
-			('A' <= url[i] && url[i] <= 'Z') ||
-			('0' <= url[i] && url[i] <= '9') ||
-			(string::npos != specials.find(url[i], 0)))
-		{
-			result += url[i];
-		}
-		else
-		{
-			result += '%';
-			result += hex[url[i] >> 4];
-			result += hex[url[i] & 15];
-		}
+		sas::BufferOutput o(out.data(), out.size());
+
+		sas::urlEncode(url, o);
 	}
 
-  return result;
+	return (ptrdiff_t)required;
 }
 
-
 //
-// Encodes the input into Base64
-string ConnectionStringHelper::encodeBase64(const uint8_t *input, int inputLength)
+// Encode string for URL
+std::pmr::string ConnectionStringHelper::urlEncode(std::string_view url, std::pmr::memory_resource *resource)
 {
-	string result = "";
+	std::pmr::string result((size_t)urlEncode(url, std::span<char>()), '\0', resource);
 
-	int8_t b;
+	urlEncode(url, result);
 
-	for (int i = 0; i < inputLength; i += 3)
-	{
-		b = (input[i] & 0xfc) >> 2;
-		result += CODES[b];
-		b = (input[i] & 0x03) << 4;
-    
-		if (i + 1 < inputLength)      
-		{
-			b |= (input[i + 1] & 0xF0) >> 4;
-			result += CODES[b];
-			b = (input[i + 1] & 0x0F) << 2;
-      
-			if (i + 2 < inputLength)  
-			{
-				b |= (input[i + 2] & 0xC0) >> 6;
-				result += CODES[b];
-				b = input[i + 2] & 0x3F;
-				result += CODES[b];
-			} 
-			else  
-			{
-				result += CODES[b];
-				result += ('=');
-			}
-		} 
-		else      
-		{
-			result += CODES[b];
-			result += ("==");
-		}    
-	}
 	return result;
 }
 
-
 //
-// Decodes from Base64
-size_t ConnectionStringHelper::decodeBase64(const string input, uint8_t *output, size_t outputLength)
+// Encodes the input into Base64 in a caller supplied buffer
+ptrdiff_t ConnectionStringHelper::encodeBase64(std::span<const uint8_t> input, std::span<char> out)
 {
-	size_t b[4];
+	size_t required = sas::base64EncodedLength(input.size());
 
-	if (input.length() % 4 != 0)
-		return -1;    // Base64 string's length must be a multiple of 4
-    
-	size_t requiredLen = (input.length() * 3) / 4 - (input.find('=') != string::npos ? (input.length() - input.find('=')) : 0);
-
-	if (outputLength == 0 || output == NULL)
-		return requiredLen;
-
-	if (requiredLen > outputLength)
-		return -2;    // Output buffer is too short
+	if (required <= out.size())
+	{
+		sas::BufferOutput o(out.data(), out.size());
 
-	int j = 0;
+		sas::encodeBase64(input.data(), input.size(), o);
+	}
 
-	for (size_t i = 0; i < input.length(); i += 4)
-	{
-		b[0] = CODES.find(input[i]);
-		b[1] = CODES.find(input[i + 1]);
-		b[2] = CODES.find(input[i + 2]);
-		b[3] = CODES.find(input[i + 3]);
+	return (ptrdiff_t)required;
+}
 
-		output[j++] = (uint8_t)(((b[0] << 2) | (b[1] >> 4)));
+//
+// Encodes the input into Base64
+std::pmr::string ConnectionStringHelper::encodeBase64(const uint8_t *input, int inputLength, std::pmr::memory_resource *resource)
+{
+	std::span<const uint8_t> in(input, (size_t)inputLength);
+	std::pmr::string result((size_t)encodeBase64(in, std::span<char>()), '\0', resource);
 
-		if (b[2] < 64)
-		{
-			output[j++] = (uint8_t)(((b[1] << 4) | (b[2] >> 2)));
-      
-			if (b[3] < 64)  
-			{
-				output[j++] = (uint8_t)(((b[2] << 6) | b[3]));
-			}
-		}
-	}
+	encodeBase64(in, result);
 
-	return requiredLen;
+	return result;
 }
 
+//
+// Decodes from Base64
+size_t ConnectionStringHelper::decodeBase64(std::string_view input, uint8_t *output, size_t outputLength)
+{
+	return (size_t)sas::decodeBase64(input, output, outputLength);
+}
 
 //
-// Returns the hashed value of the data and the key
-string ConnectionStringHelper::hashIt(const string data, uint8_t *key, size_t keyLength)
+// Private method - Build the SAS token for the specified expiry time
+std::pmr::string ConnectionStringHelper::buildPassword(int64_t tokenExpiry)
 {
-	uint8_t signedOut[32];
-	string work;
+	char work[512];
+	ptrdiff_t length = renderPassword(work, tokenExpiry);
+
+	if (length < 0)
+		return std::pmr::string(_resource);
+
+	if ((size_t)length <= sizeof(work))
+		return std::pmr::string(work, (size_t)length, _resource);
+
+	std::pmr::string result((size_t)length, '\0', _resource);
+
+	renderPassword(result, tokenExpiry);
 
-	generateHash(signedOut, (uint8_t *)data.c_str(), (size_t) data.length(), key, keyLength);
-	work = encodeBase64(signedOut, sizeof(signedOut));
-	return urlEncode(work);
+	return result;
 }
 
 //
-// Generate the SAS token for the IoT Hub
-string ConnectionStringHelper::generatePassword(int32_t tokenTTL)
+// Private method - Write the SAS token for the specified expiry time into out.
+// Uses the URI and key decoded by the constructor so nothing is allocated.
+ptrdiff_t ConnectionStringHelper::renderPassword(std::span<char> out, int64_t tokenExpiry)
 {
-	string uri;
-#ifdef _TESTING
-	int32_t epoch = 0;
-#else
-	int32_t epoch = (int32_t)time(0);
-#endif
-	int32_t tokenExpiry = epoch + tokenTTL;
+	if (!_keyValid)
+		return -1;
 
-#ifdef _DEBUG
-	printf("URL to encode >%s<\r\n", (getKeywordValue("hostname") + "/devices/" + getKeywordValue("deviceid")).c_str());
-#endif
+	sas::TokenSignature signature = sas::signToken(_keyed, _uriResource, tokenExpiry);
+	size_t required = sas::tokenLength(_uriResource, signature);
+
+	if (required <= out.size())
+	{
+		sas::BufferOutput o(out.data(), out.size());
 
-	uri = urlEncode(getKeywordValue("hostname") + "/devices/" + getKeywordValue("deviceid"));
+		sas::writeToken(o, _uriResource, signature);
+	}
 
-#ifdef _DEBUG
-	printf("URL encoded >%s<\r\n\n", uri.c_str());
-#endif
+	return (ptrdiff_t)required;
+}
 
-	string toSign = uri + "\n" + to_string(tokenExpiry);
-	uint8_t *key;
-	size_t keyLen;
+//
+// Private method - Sign a token for the specified expiry time and keep it
+// unrendered
+ConnectionStringHelper::Token ConnectionStringHelper::signPassword(int64_t tokenExpiry)
+{
+	if (!_keyValid)
+		return Token();
 
-	keyLen = decodeBase64(getKeywordValue("SharedAccessKey"), NULL, 0);
-	key = new uint8_t[keyLen];
-	keyLen = decodeBase64(getKeywordValue("SharedAccessKey"), key, keyLen);
+	return Token(_keyed, _uriResource, tokenExpiry);
+}
 
-#ifdef _DEBUG
-	printf("Decoded SharedAccessKey\r\n");
-	dumpBuffer(key, keyLen);
-	printf("\r\n");
-#endif
+//
+// Private method - Write an MQTT CONNECT packet carrying a token for the
+// specified expiry time into out
+ptrdiff_t ConnectionStringHelper::renderMqttConnect(std::span<char> out, int64_t tokenExpiry, uint16_t keepAlive)
+{
+	if (!_keyValid)
+		return -1;
 
-	string password = hashIt(toSign, key, keyLen);
+	sas::MqttIdentity identity{ keywordView("hostname"), keywordView("deviceid"), keepAlive };
 
-	delete [] key;
+	return sas::buildMqttConnect(out.data(), out.size(), identity, _keyed, _uriResource, tokenExpiry);
+}
 
-	string result;
-  
-	result = string("SharedAccessSignature sr=") + uri + "&sig=" + password + "&se=" + to_string(tokenExpiry);
+//
+// Private method - Return a keyword value without copying it, empty if the
+// keyword is not in the connection string
+std::string_view ConnectionStringHelper::keywordView(std::string_view keyword) const
+{
+	SAS_PROFILE_STAGE(KeywordLookup);
 
-	return result;
+	TKeyValue::const_iterator it = keyValue.find(keyword);
+
+	return (it == keyValue.end()) ? std::string_view() : std::string_view(it->second);
 }
 
 //
 // Private method - Build keyword value lookup map
-int ConnectionStringHelper::findTokens(const std::string connectionString)
+int ConnectionStringHelper::findTokens(std::string_view connectionString)
 {
-	int itemCount = 0;
-	size_t index = 0;
-	size_t newIndex = 0;
-	size_t eqIndex = 0;
-
-	while (index < connectionString.length())
+	int itemCount = sas::forEachToken(connectionString, [this](std::string_view keyword, std::string_view value)
 	{
-		newIndex = connectionString.find(';', index);
-
-		if (newIndex == string::npos)
-			newIndex = connectionString.length();
+		std::pmr::string lower(keyword, _resource);
 
-		eqIndex = connectionString.find('=', index);
+		std::transform(lower.begin(), lower.end(), lower.begin(), sas::toLower);
+		keyValue.emplace(std::move(lower), std::pmr::string(value, _resource));
 
-		if (eqIndex == string::npos)
-			return 0;
+		return true;
+	});
 
-		itemCount++;
-		std::string keyword = connectionString.substr(index, eqIndex - index);
-		std::transform(keyword.begin(), keyword.end(), keyword.begin(), ::tolower);
-		keyValue.insert(std::pair<const std::string, const std::string>(keyword, connectionString.substr(eqIndex + 1, newIndex - (eqIndex + 1))));
-		index = newIndex + 1;
+	if (itemCount < 0)
+	{
+		keyValue.clear();
+		return 0;
 	}
 
 	return itemCount;
 }
+
 #ifdef _DEBUG
 //
 // Dumps the buffer in hex and character
@@ -1,34 +1,193 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <span>
 #include <map>
+#include <vector>
+#include <memory_resource>
+
+#include "../SasCore/SasCore.h"
+#include "../SasCore/SasTrace.h"
+#include "TokenCache.h"
 
 using namespace std;
+using sas::RealClock;
+using sas::CoarseClock;
+using sas::FixedClock;
 
 class ConnectionStringHelper
 {
+public:
+	typedef sas::SasToken<sas::EncodedResource> Token;
+
 private:
-	typedef std::map<std::string, std::string> TKeyValue;
-	
+	// Keywords are case insensitive so compare them that way rather than making lower case copies
+	struct KeywordLess
+	{
+		typedef void is_transparent;
+
+		bool operator()(std::string_view left, std::string_view right) const { return sas::keywordLess(left, right); }
+	};
+
+	typedef std::pmr::map<std::pmr::string, std::pmr::string, KeywordLess> TKeyValue;
+
+	std::pmr::memory_resource *_resource;
 	TKeyValue keyValue;
 	int _tokenCount;
-  
-	const static std::string CODES;
+	TokenCache::Key _cacheKey;
+	std::pmr::string _encodedUri;
+	sas::EncodedResource _uriResource;
+	struct hmacSha256 _keyed;	// Keyed once by the constructor, every token starts from a copy
+	bool _keyValid;
+	const char *_deviceId;		// For the trace probes, points into keyValue
 
-	int findTokens(const std::string connectionString);
-	string hashIt(const string data, uint8_t *key, size_t keyLength);
+	int findTokens(std::string_view connectionString);
+	std::pmr::string buildPassword(int64_t tokenExpiry);
+	ptrdiff_t renderPassword(std::span<char> out, int64_t tokenExpiry);
+	Token signPassword(int64_t tokenExpiry);
+	ptrdiff_t renderMqttConnect(std::span<char> out, int64_t tokenExpiry, uint16_t keepAlive);
+	std::string_view keywordView(std::string_view keyword) const;
 #ifdef _DEBUG
 	static void dumpBuffer(uint8_t *buffer, size_t bufferLength);
 #endif
 
 public:
-	static string urlEncode(const string url);
-	static string encodeBase64(const uint8_t *input, int inputLength);
-	static size_t decodeBase64(const string input, uint8_t *output, size_t outputLength);
+	/*
+	 * The span overloads never allocate. They return the number of characters
+	 * the result needs and write nothing if that is more than out.size(). The
+	 * output is not null terminated. A negative return is an error.
+	 */
+	static ptrdiff_t urlEncode(std::string_view url, std::span<char> out);
+	static ptrdiff_t encodeBase64(std::span<const uint8_t> input, std::span<char> out);
+	static std::pmr::string urlEncode(std::string_view url, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+	static std::pmr::string encodeBase64(const uint8_t *input, int inputLength, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+	static size_t decodeBase64(std::string_view input, uint8_t *output, size_t outputLength);
 
-	ConnectionStringHelper(const std::string connectionString);
+	/*
+	 * All of the instance's storage and every string it returns is allocated
+	 * from resource. Back a group of instances with a monotonic_buffer_resource
+	 * or a pool resource to keep their data together and release it in one go.
+	 * The resource must outlive the instance and the strings it returned.
+	 */
+	ConnectionStringHelper(std::string_view connectionString, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 	~ConnectionStringHelper();
 	int tokenCount() { return _tokenCount; }
-	const std::string getKeywordValue(const std::string keyword);
-	string generatePassword(int32_t tokenTTL);
+	std::pmr::memory_resource *resource() const { return _resource; }
+	std::pmr::string getKeywordValue(std::string_view keyword);
+	std::pmr::string generatePassword(int64_t tokenTTL) { return generatePassword(tokenTTL, RealClock()); }
+	std::pmr::string generatePassword(int64_t tokenTTL, TokenCache &cache) { return generatePassword(tokenTTL, cache, RealClock()); }
+	ptrdiff_t generatePassword(std::span<char> out, int64_t tokenTTL) { return generatePassword(out, tokenTTL, RealClock()); }
+	Token generateToken(int64_t tokenTTL) { return generateToken(tokenTTL, RealClock()); }
+	ptrdiff_t generateMqttConnect(std::span<char> out, int64_t tokenTTL, uint16_t keepAlive = 240) { return generateMqttConnect(out, tokenTTL, keepAlive, RealClock()); }
+	sas::TokenSegments generateSegments(int64_t tokenTTL) { return generateSegments(tokenTTL, RealClock()); }
+
+	//
+	// Generate the SAS token for the IoT Hub using the supplied clock
+	template <sas::ClockPolicy Clock>
+	std::pmr::string generatePassword(int64_t tokenTTL, const Clock &clock)
+	{
+		SAS_TRACE2(mint_start, _deviceId, tokenTTL);
+
+		std::pmr::string result = buildPassword(clock.now() + tokenTTL);
+
+		SAS_TRACE3(mint_end, _deviceId, tokenTTL, (int)result.length());
+
+		return result;
+	}
+
+	//
+	// Generate the SAS token into a caller supplied buffer using the supplied clock
+	template <sas::ClockPolicy Clock>
+	ptrdiff_t generatePassword(std::span<char> out, int64_t tokenTTL, const Clock &clock)
+	{
+		SAS_TRACE2(mint_start, _deviceId, tokenTTL);
+
+		ptrdiff_t result = renderPassword(out, clock.now() + tokenTTL);
+
+		SAS_TRACE3(mint_end, _deviceId, tokenTTL, (int)result);
+
+		return result;
+	}
+
+	//
+	// Sign a token without rendering it. The token refers to this instance's
+	// resource URI so it must not outlive the instance. Call renderTo or
+	// render when the text is needed. Not valid() if the key was bad.
+	template <sas::ClockPolicy Clock>
+	Token generateToken(int64_t tokenTTL, const Clock &clock)
+	{
+		SAS_TRACE2(mint_start, _deviceId, tokenTTL);
+
+		Token result = signPassword(clock.now() + tokenTTL);
+
+		SAS_TRACE3(mint_end, _deviceId, tokenTTL, result.valid() ? (int)result.size() : -1);
+
+		return result;
+	}
+
+	//
+	// Sign a token and return it as segments for a gather write, see
+	// sas::TokenSegments. Only the signature and expiry are written, the rest
+	// points at constants and this instance's URI, so the segments must not
+	// outlive the instance. There are none if the key was bad.
+	template <sas::ClockPolicy Clock>
+	sas::TokenSegments generateSegments(int64_t tokenTTL, const Clock &clock)
+	{
+		return sas::TokenSegments(generateToken(tokenTTL, clock));
+	}
+
+	//
+	// Write a complete MQTT 3.1.1 CONNECT packet for the device into out, with
+	// a freshly signed token as the password. Same return convention as the
+	// span overloads, -1 if the key was bad.
+	template <sas::ClockPolicy Clock>
+	ptrdiff_t generateMqttConnect(std::span<char> out, int64_t tokenTTL, uint16_t keepAlive, const Clock &clock)
+	{
+		SAS_TRACE2(mint_start, _deviceId, tokenTTL);
+
+		ptrdiff_t result = renderMqttConnect(out, clock.now() + tokenTTL, keepAlive);
+
+		SAS_TRACE3(mint_end, _deviceId, tokenTTL, (int)result);
+
+		return result;
+	}
+
+	//
+	// Generate the SAS token for the IoT Hub or reuse one from the cache. A cached
+	// token is reused while at least half of tokenTTL remains before it expires.
+	// cacheHit, if given, is set to whether the token came from the cache.
+	template <sas::ClockPolicy Clock>
+	std::pmr::string generatePassword(int64_t tokenTTL, TokenCache &cache, const Clock &clock, bool *cacheHit = nullptr)
+	{
+		int64_t epoch = clock.now();
+		std::pmr::string result(_resource);
+		bool hit = cache.lookup(_cacheKey, epoch + tokenTTL / 2, result);
+
+		if (cacheHit != nullptr)
+			*cacheHit = hit;
+
+		if (hit)
+		{
+			SAS_TRACE2(cache_hit, _deviceId, tokenTTL);
+
+			return result;
+		}
+
+		SAS_TRACE2(cache_miss, _deviceId, tokenTTL);
+		SAS_TRACE2(mint_start, _deviceId, tokenTTL);
+
+		result = buildPassword(epoch + tokenTTL);
+
+		SAS_TRACE3(mint_end, _deviceId, tokenTTL, (int)result.length());
+
+		cache.insert(_cacheKey, epoch + tokenTTL, epoch, result);
+
+		return result;
+	}
+
+private:
+	// Tokens refer to _uriResource so instances stay where they were made
+	ConnectionStringHelper(const ConnectionStringHelper &) = delete;
+	ConnectionStringHelper &operator=(const ConnectionStringHelper &) = delete;
 };
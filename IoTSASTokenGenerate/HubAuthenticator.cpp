@@ -0,0 +1,156 @@
+#include "stdafx.h"
+
+#include <thread>
+#include <vector>
+
+#include "HubAuthenticator.h"
+
+// Longest decoded resource URI accepted
+static const size_t MAX_RESOURCE_LENGTH = 512;
+
+/*
+ * Constructor
+ *
+ *  resource          Memory resource for the device table
+ */
+HubAuthenticator::HubAuthenticator(std::pmr::memory_resource *resource)
+	: _devices(resource)
+{
+}
+
+//
+// Registers a device. Returns false if the key is not Base64.
+bool HubAuthenticator::addDevice(std::string_view hostName, std::string_view deviceId, std::string_view sharedAccessKey)
+{
+	ptrdiff_t keyLen = sas::decodeBase64(sharedAccessKey, nullptr, 0);
+
+	if (keyLen <= 0)
+		return false;
+
+	std::pmr::vector<uint8_t> key((size_t)keyLen, _devices.get_allocator().resource());
+
+	if (sas::decodeBase64(sharedAccessKey, key.data(), key.size()) != keyLen)
+		return false;
+
+	struct hmacSha256 keyed;
+	std::pmr::string uri(hostName, _devices.get_allocator().resource());
+
+	sas::hmacSha256Init(keyed, key.data(), key.size());
+	uri += "/devices/";
+	uri += deviceId;
+	_devices.insert_or_assign(std::move(uri), sas::hmacSha256Midstate(keyed));
+
+	return true;
+}
+
+//
+// Registers the device in a connection string
+bool HubAuthenticator::addDevice(std::string_view connectionString)
+{
+	std::string_view hostName;
+	std::string_view deviceId;
+	std::string_view sharedAccessKey;
+
+	int count = sas::forEachToken(connectionString, [&](std::string_view keyword, std::string_view value)
+	{
+		if (sas::keywordEquals(keyword, "HostName"))
+			hostName = value;
+		else if (sas::keywordEquals(keyword, "DeviceId"))
+			deviceId = value;
+		else if (sas::keywordEquals(keyword, "SharedAccessKey"))
+			sharedAccessKey = value;
+
+		return true;
+	});
+
+	if (count <= 0 || hostName.empty() || deviceId.empty())
+		return false;
+
+	return addDevice(hostName, deviceId, sharedAccessKey);
+}
+
+//
+// Checks a token the way the hub would for a device connecting
+sas::TokenStatus HubAuthenticator::validate(std::string_view token, int64_t now) const
+{
+	sas::ParsedToken parsed;
+
+	if (!sas::parseToken(token, parsed))
+		return sas::TokenStatus::Malformed;
+
+	return validate(parsed, std::string_view(), now);
+}
+
+//
+// Checks an MQTT CONNECT packet. The password must be a valid token for the
+// device named by the client id.
+sas::TokenStatus HubAuthenticator::validateConnect(std::string_view packet, int64_t now) const
+{
+	sas::MqttConnectFields fields;
+	sas::ParsedToken parsed;
+
+	if (sas::readMqttConnect(packet, fields) <= 0 || fields.clientId.empty() || !sas::parseToken(fields.password, parsed))
+		return sas::TokenStatus::Malformed;
+
+	return validate(parsed, fields.clientId, now);
+}
+
+//
+// Validates a batch across threads. Each thread takes a contiguous run.
+void HubAuthenticator::validateBatch(std::span<const std::string_view> tokens, std::span<sas::TokenStatus> results, int64_t now, unsigned threadCount) const
+{
+	size_t count = tokens.size() < results.size() ? tokens.size() : results.size();
+
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+
+	if (threadCount == 0)
+		threadCount = 1;
+
+	size_t share = (count + threadCount - 1) / threadCount;
+	auto validateRun = [this, tokens, results, now](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			results[i] = validate(tokens[i], now);
+	};
+
+	std::vector<std::thread> threads;
+
+	for (size_t begin = share; begin < count; begin += share)
+		threads.emplace_back(validateRun, begin, begin + share < count ? begin + share : count);
+
+	validateRun(0, share < count ? share : count);
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+//
+// Private method - Looks up the device for the token's resource and checks
+// the signature with its midstate. If deviceId is not empty the resource
+// must be for that device.
+sas::TokenStatus HubAuthenticator::validate(const sas::ParsedToken &parsed, std::string_view deviceId, int64_t now) const
+{
+	char resource[MAX_RESOURCE_LENGTH];
+	sas::BufferOutput out(resource, sizeof(resource));
+
+	if (!sas::urlDecode(parsed.resource, out) || out.overflowed())
+		return sas::TokenStatus::Malformed;
+
+	std::string_view uri(resource, out.count());
+
+	if (!deviceId.empty())
+	{
+		size_t devices = uri.find("/devices/");
+
+		if (devices == std::string_view::npos || uri.substr(devices + 9) != deviceId)
+			return sas::TokenStatus::UnknownDevice;
+	}
+
+	TDevices::const_iterator it = _devices.find(uri);
+
+	if (it == _devices.end())
+		return sas::TokenStatus::UnknownDevice;
+
+	return sas::verifyToken(parsed, it->second, now);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <unordered_map>
+#include <memory_resource>
+#include <stdint.h>
+
+#include "../SasCore/SasCore.h"
+
+/*
+ * Local stand-in for an IoT hub's authentication front end, for load testing
+ * device fleets without Azure.
+ *
+ * Devices are registered up front with their keys. Each one is kept as its
+ * HMAC midstate, keyed on the resource URI "<hostName>/devices/<deviceId>",
+ * so checking a token never runs the key schedule. The table is read only
+ * once loaded and any number of threads may validate against it.
+ */
+class HubAuthenticator
+{
+public:
+	HubAuthenticator(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+	bool addDevice(std::string_view hostName, std::string_view deviceId, std::string_view sharedAccessKey);
+	bool addDevice(std::string_view connectionString);
+	size_t deviceCount() const { return _devices.size(); }
+
+	sas::TokenStatus validate(std::string_view token, int64_t now) const;
+	sas::TokenStatus validateConnect(std::string_view packet, int64_t now) const;
+
+	//
+	// Validates tokens[i] into results[i], splitting the batch across
+	// threadCount threads or one per core if threadCount is 0
+	void validateBatch(std::span<const std::string_view> tokens, std::span<sas::TokenStatus> results, int64_t now, unsigned threadCount = 0) const;
+
+private:
+	struct ResourceHash
+	{
+		typedef void is_transparent;
+
+		size_t operator()(std::string_view resource) const { return std::hash<std::string_view>()(resource); }
+	};
+
+	typedef std::pmr::unordered_map<std::pmr::string, sas::HmacMidstate, ResourceHash, std::equal_to<>> TDevices;
+
+	TDevices _devices;
+
+	sas::TokenStatus validate(const sas::ParsedToken &parsed, std::string_view deviceId, int64_t now) const;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <bit>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Log linear latency histogram in the style of HdrHistogram. Values below 256
+ * are counted exactly and larger ones in 128 buckets per power of two, so any
+ * value is reported within 1%. Recording is an increment with no allocation.
+ * Give each thread its own histogram and merge them afterwards.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() { clear(); }
+
+	void clear()
+	{
+		for (size_t i = 0; i < BUCKET_COUNT; i++)
+			_counts[i] = 0;
+
+		_count = 0;
+		_max = 0;
+	}
+
+	void record(uint64_t value)
+	{
+		_counts[bucket(value)]++;
+		_count++;
+
+		if (value > _max)
+			_max = value;
+	}
+
+	void merge(const LatencyHistogram &other)
+	{
+		for (size_t i = 0; i < BUCKET_COUNT; i++)
+			_counts[i] += other._counts[i];
+
+		_count += other._count;
+
+		if (other._max > _max)
+			_max = other._max;
+	}
+
+	uint64_t count() const { return _count; }
+	uint64_t max() const { return _max; }
+
+	//
+	// The highest value in the bucket holding the given percentile, 0 to 100
+	uint64_t percentile(double percent) const
+	{
+		uint64_t rank = (uint64_t)(percent / 100.0 * (double)_count + 0.5);
+		uint64_t seen = 0;
+
+		if (rank == 0)
+			rank = 1;
+
+		for (size_t i = 0; i < BUCKET_COUNT; i++)
+		{
+			seen += _counts[i];
+
+			if (seen >= rank)
+				return highestInBucket(i) < _max ? highestInBucket(i) : _max;
+		}
+
+		return _max;
+	}
+
+private:
+	static const int SUB_BITS = 7;
+	static const uint64_t EXACT = (uint64_t)2 << SUB_BITS;
+	static const size_t BUCKET_COUNT = EXACT + (64 - SUB_BITS - 1) * ((size_t)1 << SUB_BITS);
+
+	uint64_t _counts[BUCKET_COUNT];
+	uint64_t _count;
+	uint64_t _max;
+
+	static size_t bucket(uint64_t value)
+	{
+		if (value < EXACT)
+			return (size_t)value;
+
+		int shift = std::bit_width(value) - (SUB_BITS + 1);
+
+		return (size_t)(EXACT + (uint64_t)(shift - 1) * ((uint64_t)1 << SUB_BITS) + ((value >> shift) - ((uint64_t)1 << SUB_BITS)));
+	}
+
+	static uint64_t highestInBucket(size_t index)
+	{
+		if (index < EXACT)
+			return index;
+
+		int shift = (int)((index - EXACT) >> SUB_BITS) + 1;
+		uint64_t top = ((index - EXACT) & (((uint64_t)1 << SUB_BITS) - 1)) + ((uint64_t)1 << SUB_BITS);
+
+		return ((top + 1) << shift) - 1;
+	}
+};
@@ -0,0 +1,210 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConnectionStringHelper.h"
+#include "LatencyHistogram.h"
+#include "LoadGenerator.h"
+
+// Simulated time of the first storm
+static const int64_t STORM_EPOCH = 1700000000;
+
+namespace
+{
+	// What one worker thread measured during a storm
+	struct WorkerResults
+	{
+		LatencyHistogram queueing;
+		LatencyHistogram hit;
+		LatencyHistogram miss;
+	};
+
+	void printPercentiles(const char *name, const LatencyHistogram &histogram)
+	{
+		if (histogram.count() == 0)
+		{
+			printf("  %-12s %10s\r\n", name, "-");
+			return;
+		}
+
+		printf("  %-12s %10.1f %10.1f %10.1f %10.1f %10llu\r\n", name,
+			histogram.percentile(50.0) / 1000.0, histogram.percentile(99.0) / 1000.0,
+			histogram.percentile(99.9) / 1000.0, histogram.max() / 1000.0,
+			(unsigned long long)histogram.count());
+	}
+
+	void printReport(const WorkerResults &results, double seconds)
+	{
+		LatencyHistogram mint;
+		uint64_t requests = results.hit.count() + results.miss.count();
+
+		mint.merge(results.hit);
+		mint.merge(results.miss);
+
+		printf("  throughput   %.0f tokens/s over %.2f s\r\n", seconds > 0 ? requests / seconds : 0.0, seconds);
+		printf("  cache        %llu hits, %llu misses (%.1f%% hits)\r\n",
+			(unsigned long long)results.hit.count(), (unsigned long long)results.miss.count(),
+			requests ? 100.0 * results.hit.count() / requests : 0.0);
+		printf("  %-12s %10s %10s %10s %10s %10s\r\n", "(us)", "p50", "p99", "p99.9", "max", "count");
+		printPercentiles("queueing", results.queueing);
+		printPercentiles("mint", mint);
+		printPercentiles("mint hit", results.hit);
+		printPercentiles("mint miss", results.miss);
+	}
+}
+
+int runReconnectStorm(const StormOptions &options)
+{
+	std::string_view hostName;
+	std::string_view deviceId;
+	std::string_view groupKey;
+	struct hmacSha256 groupKeyed;
+
+	sas::forEachToken(options.connectionString, [&](std::string_view keyword, std::string_view value)
+	{
+		if (sas::keywordEquals(keyword, "HostName"))
+			hostName = value;
+		else if (sas::keywordEquals(keyword, "DeviceId"))
+			deviceId = value;
+		else if (sas::keywordEquals(keyword, "SharedAccessKey"))
+			groupKey = value;
+
+		return true;
+	});
+
+	if (hostName.empty() || deviceId.empty() || options.devices == 0 || !sas::initGroupKey(groupKeyed, groupKey))
+	{
+		printf("The connection string needs HostName, DeviceId and a valid SharedAccessKey\r\n");
+		return 4;
+	}
+
+	unsigned threadCount = options.threads ? options.threads : std::thread::hardware_concurrency();
+
+	if (threadCount == 0)
+		threadCount = 1;
+
+	// Build the fleet. Helpers can not move so they live in a deque, with all
+	// of their storage in one arena.
+	std::pmr::monotonic_buffer_resource arena;
+	std::deque<ConnectionStringHelper> fleet;
+
+	for (size_t i = 0; i < options.devices; i++)
+	{
+		std::string id = std::string(deviceId) + "-" + std::to_string(i);
+		std::string cs = "HostName=" + std::string(hostName) + ";DeviceId=" + id + ";SharedAccessKey=";
+		uint8_t key[SHA256_DIGEST_LENGTH];
+		sas::StringOutput<std::string> out(cs);
+
+		sas::deriveDeviceKey(groupKeyed, id, key);
+		sas::encodeBase64(key, sizeof(key), out);
+		fleet.emplace_back(cs, &arena);
+	}
+
+	TokenCache cache(options.devices * 2);
+	std::mt19937_64 random(options.seed);
+	std::vector<size_t> order(options.devices);
+	std::vector<int64_t> ttl(options.devices);
+	std::vector<WorkerResults> workers(threadCount);
+	std::unique_ptr<WorkerResults> total = std::make_unique<WorkerResults>();
+	std::unique_ptr<WorkerResults> stormResults = std::make_unique<WorkerResults>();
+	double totalSeconds = 0;
+
+	printf("Reconnect storm: %zu devices, %d storms of %.1f s, TTL %lld s, jitter %.0f%%, %u threads\r\n",
+		options.devices, options.storms, options.stormSeconds, (long long)options.tokenTTL, options.jitter * 100.0, threadCount);
+
+	for (int storm = 0; storm < options.storms; storm++)
+	{
+		FixedClock clock(STORM_EPOCH + storm * (options.tokenTTL / 3));
+		std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+		for (size_t i = 0; i < options.devices; i++)
+		{
+			order[i] = i;
+			ttl[i] = (int64_t)(options.tokenTTL * (1.0 - options.jitter * unit(random)));
+		}
+
+		std::shuffle(order.begin(), order.end(), random);
+
+		for (WorkerResults &worker : workers)
+		{
+			worker.queueing.clear();
+			worker.hit.clear();
+			worker.miss.clear();
+		}
+
+		std::atomic<size_t> next(0);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double spacing = options.stormSeconds * 1e9 / (double)options.devices;
+
+		auto work = [&](WorkerResults &results)
+		{
+			size_t position;
+
+			while ((position = next.fetch_add(1, std::memory_order_relaxed)) < options.devices)
+			{
+				std::chrono::steady_clock::time_point arrival = start + std::chrono::nanoseconds((int64_t)(spacing * position));
+
+				if (arrival > std::chrono::steady_clock::now())
+					std::this_thread::sleep_until(arrival);
+
+				size_t device = order[position];
+				bool hit = false;
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				std::pmr::string token = fleet[device].generatePassword(ttl[device], cache, clock, &hit);
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+				results.queueing.record(begin > arrival ? (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(begin - arrival).count() : 0);
+				(hit ? results.hit : results.miss).record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+			}
+		};
+
+		std::vector<std::thread> threads;
+
+		for (unsigned i = 1; i < threadCount; i++)
+			threads.emplace_back(work, std::ref(workers[i]));
+
+		work(workers[0]);
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		stormResults->queueing.clear();
+		stormResults->hit.clear();
+		stormResults->miss.clear();
+
+		for (WorkerResults &worker : workers)
+		{
+			stormResults->queueing.merge(worker.queueing);
+			stormResults->hit.merge(worker.hit);
+			stormResults->miss.merge(worker.miss);
+		}
+
+		total->queueing.merge(stormResults->queueing);
+		total->hit.merge(stormResults->hit);
+		total->miss.merge(stormResults->miss);
+		totalSeconds += seconds;
+
+		printf("\r\nStorm %d of %d\r\n", storm + 1, options.storms);
+		printReport(*stormResults, seconds);
+	}
+
+	TokenCache::Stats stats = cache.stats();
+
+	printf("\r\nAll storms\r\n");
+	printReport(*total, totalSeconds);
+	printf("  token cache  %llu inserts, %llu evictions, %llu read retries, %llu write collisions\r\n",
+		(unsigned long long)stats.inserts, (unsigned long long)stats.evictions,
+		(unsigned long long)stats.readRetries, (unsigned long long)stats.writeCollisions);
+
+	return 0;
+}
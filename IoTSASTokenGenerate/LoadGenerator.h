@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string_view>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reconnect storm load generator. Simulates a fleet of devices that all
+ * reconnect within a short window, as they do after a hub failover or a
+ * network outage, and drives ConnectionStringHelper::generatePassword with a
+ * shared TokenCache the way a gateway would.
+ *
+ * The fleet is derived from one connection string: device i has device id
+ * "<DeviceId>-<i>" and the key derived from SharedAccessKey the way a DPS
+ * group enrollment derives it. Each storm happens a third of the token TTL
+ * after the previous one on a simulated clock, while latencies are measured
+ * on the real one. Every reconnect asks for a TTL up to jitter shorter than
+ * tokenTTL, so jitter sets how many cached tokens still have half their
+ * life left at the next storm.
+ */
+struct StormOptions
+{
+	std::string_view connectionString;
+	size_t devices = 10000;
+	double stormSeconds = 10.0;		// Window all devices reconnect in, 0 for as fast as possible
+	int64_t tokenTTL = 3600;
+	double jitter = 0.25;			// Fraction of tokenTTL each renewal may be shorter by
+	int storms = 3;
+	unsigned threads = 0;			// 0 for one per core
+	uint64_t seed = 1;
+};
+
+//
+// Runs the storms and prints throughput and latency percentiles for queueing
+// and minting, split by cache hit and miss. Returns 0, or 4 if the connection
+// string is not usable.
+int runReconnectStorm(const StormOptions &options);
@@ -0,0 +1,270 @@
+#include "stdafx.h"
+
+#include <string.h>
+#include <thread>
+
+#include "../SasCore/Sha256Core.h"
+#include "TokenCache.h"
+
+/*
+ * Constructor
+ *
+ *  capacity          Number of entries. This is rounded up to a power of two
+ *                    and never changes afterwards.
+ */
+TokenCache::TokenCache(size_t capacity)
+	: _hits(0), _misses(0), _inserts(0), _evictions(0), _readRetries(0), _writeCollisions(0)
+{
+	_capacity = PROBE_LENGTH;
+
+	while (_capacity < capacity)
+		_capacity <<= 1;
+
+	_mask = _capacity - 1;
+	_entries = new Entry[_capacity];
+
+	for (size_t i = 0; i < _capacity; i++)
+	{
+		Entry &entry = _entries[i];
+
+		entry.sequence.store(0, std::memory_order_relaxed);
+		entry.length.store(0, std::memory_order_relaxed);
+		entry.keyHi.store(0, std::memory_order_relaxed);
+		entry.keyLo.store(0, std::memory_order_relaxed);
+		entry.expiry.store(0, std::memory_order_relaxed);
+	}
+}
+
+/*
+ * Destructor
+ */
+TokenCache::~TokenCache()
+{
+	delete [] _entries;
+}
+
+//
+// Builds the cache key for an identity. The shared access key only contributes
+// to a SHA256 digest so it cannot be recovered from the cache.
+TokenCache::Key TokenCache::makeKey(std::string_view hostName, std::string_view deviceId, std::string_view moduleId, std::string_view sharedAccessKey)
+{
+	struct sha256 s;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+
+	sas::sha256Init(s);
+	sas::sha256Update(s, hostName.data(), hostName.length());
+	sas::sha256Update(s, "", 1);
+	sas::sha256Update(s, deviceId.data(), deviceId.length());
+	sas::sha256Update(s, "", 1);
+	sas::sha256Update(s, moduleId.data(), moduleId.length());
+	sas::sha256Update(s, "", 1);
+	sas::sha256Update(s, sharedAccessKey.data(), sharedAccessKey.length());
+	sas::sha256Sum(s, digest);
+
+	Key key = { 0, 0 };
+
+	for (int i = 0; i < 8; i++)
+	{
+		key.hi = (key.hi << 8) | digest[i];
+		key.lo = (key.lo << 8) | digest[i + 8];
+	}
+
+	return key;
+}
+
+//
+// Looks for a token for key that is valid until at least minExpiry
+bool TokenCache::lookup(const Key &key, int64_t minExpiry, std::string &token)
+{
+	uint64_t words[TOKEN_WORDS];
+	size_t length = lookup(key, minExpiry, words);
+
+	if (length != 0)
+		token.assign((const char *)words, length);
+
+	return length != 0;
+}
+
+//
+// Looks for a token for key that is valid until at least minExpiry. The token
+// is allocated from token's memory resource.
+bool TokenCache::lookup(const Key &key, int64_t minExpiry, std::pmr::string &token)
+{
+	uint64_t words[TOKEN_WORDS];
+	size_t length = lookup(key, minExpiry, words);
+
+	if (length != 0)
+		token.assign((const char *)words, length);
+
+	return length != 0;
+}
+
+//
+// Private method - Copies the token for key into words and returns its length
+// or zero if there is none. Never blocks; if a writer is updating an entry the
+// reader retries.
+size_t TokenCache::lookup(const Key &key, int64_t minExpiry, uint64_t *words)
+{
+	size_t index = (size_t)key.lo & _mask;
+
+	for (size_t probe = 0; probe < PROBE_LENGTH; probe++)
+	{
+		Entry &entry = _entries[(index + probe) & _mask];
+
+		for (;;)
+		{
+			uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+
+			if (sequence & 1)
+			{
+				// Writer is mid update - let it finish
+				_readRetries.fetch_add(1, std::memory_order_relaxed);
+				std::this_thread::yield();
+				continue;
+			}
+
+			uint32_t length = entry.length.load(std::memory_order_relaxed);
+			bool match = length != 0 &&
+				entry.keyHi.load(std::memory_order_relaxed) == key.hi &&
+				entry.keyLo.load(std::memory_order_relaxed) == key.lo;
+			int64_t expiry = entry.expiry.load(std::memory_order_relaxed);
+			bool valid = match && expiry >= minExpiry && length <= MAX_TOKEN_LENGTH;
+
+			if (valid)
+			{
+				for (size_t i = 0; i < (length + sizeof(uint64_t) - 1) / sizeof(uint64_t); i++)
+					words[i] = entry.token[i].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (entry.sequence.load(std::memory_order_relaxed) != sequence)
+			{
+				_readRetries.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			if (valid)
+			{
+				_hits.fetch_add(1, std::memory_order_relaxed);
+				return length;
+			}
+
+			if (match)
+			{
+				// Found the identity but the token is too close to expiry
+				_misses.fetch_add(1, std::memory_order_relaxed);
+				return 0;
+			}
+
+			break;
+		}
+	}
+
+	_misses.fetch_add(1, std::memory_order_relaxed);
+
+	return 0;
+}
+
+//
+// Stores a token. The entry is chosen from the probe window in this order:
+// the entry already holding key, an empty or expired entry, the entry that
+// expires soonest. If another writer holds the chosen entry the insert is
+// dropped - the cache is best effort.
+void TokenCache::insert(const Key &key, int64_t expiry, int64_t now, std::string_view token)
+{
+	if (token.length() == 0 || token.length() > MAX_TOKEN_LENGTH)
+		return;
+
+	size_t index = (size_t)key.lo & _mask;
+	Entry *victim = NULL;
+	int64_t victimExpiry = INT64_MAX;
+	bool victimFree = false;
+
+	for (size_t probe = 0; probe < PROBE_LENGTH; probe++)
+	{
+		Entry *entry = &_entries[(index + probe) & _mask];
+		uint32_t length = entry->length.load(std::memory_order_relaxed);
+		int64_t entryExpiry = entry->expiry.load(std::memory_order_relaxed);
+
+		if (length != 0 &&
+			entry->keyHi.load(std::memory_order_relaxed) == key.hi &&
+			entry->keyLo.load(std::memory_order_relaxed) == key.lo)
+		{
+			victim = entry;
+			victimFree = true;
+			break;
+		}
+
+		if (victimFree)
+			continue;
+
+		if (length == 0 || entryExpiry <= now)
+		{
+			victim = entry;
+			victimFree = true;
+		}
+		else if (entryExpiry < victimExpiry)
+		{
+			victim = entry;
+			victimExpiry = entryExpiry;
+		}
+	}
+
+	uint32_t sequence = victim->sequence.load(std::memory_order_relaxed);
+
+	if ((sequence & 1) ||
+		!victim->sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+	{
+		_writeCollisions.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (!victimFree)
+		_evictions.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t words[TOKEN_WORDS] = { 0 };
+
+	memcpy(words, token.data(), token.length());
+
+	for (size_t i = 0; i < (token.length() + sizeof(uint64_t) - 1) / sizeof(uint64_t); i++)
+		victim->token[i].store(words[i], std::memory_order_relaxed);
+
+	victim->keyHi.store(key.hi, std::memory_order_relaxed);
+	victim->keyLo.store(key.lo, std::memory_order_relaxed);
+	victim->expiry.store(expiry, std::memory_order_relaxed);
+	victim->length.store((uint32_t)token.length(), std::memory_order_relaxed);
+	victim->sequence.store(sequence + 2, std::memory_order_release);
+
+	_inserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+//
+// Returns a snapshot of the counters
+TokenCache::Stats TokenCache::stats() const
+{
+	Stats result;
+
+	result.hits = _hits.load(std::memory_order_relaxed);
+	result.misses = _misses.load(std::memory_order_relaxed);
+	result.inserts = _inserts.load(std::memory_order_relaxed);
+	result.evictions = _evictions.load(std::memory_order_relaxed);
+	result.readRetries = _readRetries.load(std::memory_order_relaxed);
+	result.writeCollisions = _writeCollisions.load(std::memory_order_relaxed);
+
+	return result;
+}
+
+//
+// Returns hits / (hits + misses) or zero if there have been no lookups
+double TokenCache::hitRatio() const
+{
+	uint64_t hits = _hits.load(std::memory_order_relaxed);
+	uint64_t lookups = hits + _misses.load(std::memory_order_relaxed);
+
+	return lookups == 0
+		? 0.0
+		: (double)hits / (double)lookups;
+}
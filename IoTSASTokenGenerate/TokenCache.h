@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <memory_resource>
+#include <stdint.h>
+
+/*
+ * Fixed size token cache that can be shared by any number of threads.
+ *
+ * Entries live in an open addressing table. Each entry is protected by a
+ * sequence lock so a lookup never blocks: readers copy the entry and retry
+ * if a writer changed it underneath them. Writers claim an entry by moving
+ * its sequence number from even to odd. The table never grows, so the memory
+ * footprint is fixed at construction time.
+ */
+class TokenCache
+{
+public:
+	// Identifies an identity: hostname, device id, module id and a fingerprint of the key
+	struct Key
+	{
+		uint64_t hi;
+		uint64_t lo;
+	};
+
+	struct Stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t inserts;
+		uint64_t evictions;
+		uint64_t readRetries;		// Reader saw a writer in progress and had to retry
+		uint64_t writeCollisions;	// Writer found the entry claimed by another writer
+	};
+
+	// Tokens longer than this are not cached
+	static const size_t MAX_TOKEN_LENGTH = 256;
+
+	static Key makeKey(std::string_view hostName, std::string_view deviceId, std::string_view moduleId, std::string_view sharedAccessKey);
+
+	TokenCache(size_t capacity);
+	~TokenCache();
+
+	bool lookup(const Key &key, int64_t minExpiry, std::string &token);
+	bool lookup(const Key &key, int64_t minExpiry, std::pmr::string &token);
+	void insert(const Key &key, int64_t expiry, int64_t now, std::string_view token);
+
+	size_t capacity() const { return _capacity; }
+	size_t memoryFootprint() const { return sizeof(*this) + _capacity * sizeof(Entry); }
+	Stats stats() const;
+	double hitRatio() const;
+
+private:
+	static const size_t PROBE_LENGTH = 8;
+	static const size_t TOKEN_WORDS = MAX_TOKEN_LENGTH / sizeof(uint64_t);
+
+	struct Entry
+	{
+		std::atomic<uint32_t> sequence;
+		std::atomic<uint32_t> length;
+		std::atomic<uint64_t> keyHi;
+		std::atomic<uint64_t> keyLo;
+		std::atomic<int64_t> expiry;
+		std::atomic<uint64_t> token[TOKEN_WORDS];
+	};
+
+	size_t lookup(const Key &key, int64_t minExpiry, uint64_t *words);
+
+	Entry *_entries;
+	size_t _capacity;
+	size_t _mask;
+
+	std::atomic<uint64_t> _hits;
+	std::atomic<uint64_t> _misses;
+	std::atomic<uint64_t> _inserts;
+	std::atomic<uint64_t> _evictions;
+	std::atomic<uint64_t> _readRetries;
+	std::atomic<uint64_t> _writeCollisions;
+
+	TokenCache(const TokenCache &) = delete;
+	TokenCache &operator=(const TokenCache &) = delete;
+};
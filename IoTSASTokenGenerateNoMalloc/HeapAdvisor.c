@@ -0,0 +1,119 @@
+#include <string.h>
+#include "ConnectionStringHelper_NoMalloc.h"
+#include "HeapAdvisor.h"
+
+// Host only, the trial buffer alone is 64KB of static memory
+#ifdef SAS_HEAP_ADVISOR
+
+#define ADVISE_MAX_BUFFER UINT16_MAX		// The most heapInit takes
+#define ADVISE_EPOCH 1735689600				// Fixed so every token is the same length
+
+static unsigned char adviseBuffer[ADVISE_MAX_BUFFER];
+
+int heapAdviseTrial(const char* connectionString, size_t bufferLen);
+int heapAdviseMint(CONNECTIONSTRINGHANDLE csh, char** password);
+
+// Find the smallest buffer for the connection string and the size to build with
+int HeapAdviseConnectionString(const char* connectionString, int marginPercent, HEAPADVICE* advice)
+{
+	memset(advice, 0, sizeof(*advice));
+
+	if (connectionString == NULL || marginPercent < 0 || heapAdviseTrial(connectionString, ADVISE_MAX_BUFFER) < 0)
+		return -1;
+
+	// low always fails and high always works
+	size_t low = 0;
+	size_t high = ADVISE_MAX_BUFFER;
+
+	while (high - low > 1)
+	{
+		size_t mid = low + (high - low) / 2;
+
+		if (heapAdviseTrial(connectionString, mid) >= 0)
+			high = mid;
+		else
+			low = mid;
+	}
+
+	size_t smallest = high;
+	size_t recommended;
+
+	for (;;)
+	{
+		size_t failed = 0;
+
+		recommended = (smallest + smallest * (size_t)marginPercent / 100 + 15) & ~(size_t)15;
+
+		if (recommended > ADVISE_MAX_BUFFER)
+			recommended = ADVISE_MAX_BUFFER;
+
+		for (size_t size = smallest; size <= recommended; size++)
+		{
+			if (heapAdviseTrial(connectionString, size) < 0)
+				failed = size;
+		}
+
+		if (failed == 0)
+			break;
+
+		smallest = failed + 1;
+	}
+
+	advice->smallestBuffer = smallest;
+	advice->recommendedBuffer = recommended;
+	advice->peakUsedBytes = heapAdviseTrial(connectionString, smallest);
+	advice->overheadBytes = (int)smallest - advice->peakUsedBytes;
+
+	return 0;
+}
+
+// Run the lifecycle in the first bufferLen bytes of the buffer. Returns the
+// most bytes in use at once, or -1 if it ran out of memory.
+int heapAdviseTrial(const char* connectionString, size_t bufferLen)
+{
+	CONNECTIONSTRINGHANDLE csh = CreateConnectionStringHandle(connectionString, adviseBuffer, bufferLen);
+
+	if (csh == NULL)
+		return -1;
+
+	int64_t now = ADVISE_EPOCH;
+	char* current = NULL;
+	int ok;
+
+	SetConnectionStringClock(csh, sasClockFixed, &now);
+	ok = heapAdviseMint(csh, &current) == 0;
+
+	for (int i = 0; ok && i < HEAPADVISOR_CYCLES; i++)
+	{
+		char* next = NULL;
+
+		ok = heapAdviseMint(csh, &next) == 0;
+		heapFree(csh->hHeap, current);
+		current = next;
+	}
+
+	HEAPINFO heapInfo;
+
+	heapFree(csh->hHeap, current);
+	heapGetInfo(csh->hHeap, &heapInfo);
+	DestroyConnectionStringHandle(csh);
+
+	return ok ? heapInfo.peakUsedBytes : -1;
+}
+
+// Mint a token into a block allocated for it, as the sample does
+int heapAdviseMint(CONNECTIONSTRINGHANDLE csh, char** password)
+{
+	int passwordLen = generatePassword(csh, 3600, NULL, 0);
+
+	if (passwordLen < 0)
+		return -1;
+
+	*password = (char*)heapMalloc(csh->hHeap, passwordLen);
+
+	if (*password == NULL)
+		return -1;
+
+	return generatePassword(csh, 3600, *password, passwordLen) == passwordLen ? 0 : -1;
+}
+#endif
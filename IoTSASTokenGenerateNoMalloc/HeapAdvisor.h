@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Token refreshes each buffer size has to survive
+#define HEAPADVISOR_CYCLES 8
+
+typedef struct _HEAPADVICE
+{
+	size_t smallestBuffer;		// Smallest buffer the lifecycle works in
+	size_t recommendedBuffer;	// smallestBuffer plus the margin, a multiple of 16
+	int peakUsedBytes;			// Most allocated at once in the smallest buffer
+	int overheadBytes;			// The rest of it: heap and block headers and fragmentation
+} HEAPADVICE;
+
+/*
+ * Only built with SAS_HEAP_ADVISOR defined, it needs a 64KB scratch buffer
+ * that has no place in a device build.
+ *
+ * Finds the smallest heap buffer a device with this connection string can
+ * run in. Each size tried runs the lifecycle of the sample: parse, then
+ * HEAPADVISOR_CYCLES token refreshes where the new token is minted into a
+ * new heap block before the old one is freed. The free list is first fit by
+ * size, so the result includes whatever fragmentation that causes.
+ *
+ * The smallest size is binary searched, then every size from it up to the
+ * recommendation is run as well, because fragmentation can make a bigger
+ * buffer fail where a smaller one worked. Returns 0, or -1 if no buffer
+ * heapInit accepts is big enough.
+ */
+int HeapAdviseConnectionString(const char* connectionString, int marginPercent, HEAPADVICE* advice);
+
+#ifdef __cplusplus
+}
+#endif
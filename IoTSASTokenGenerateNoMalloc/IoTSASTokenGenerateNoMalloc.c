@@ -2,19 +2,55 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ConnectionStringHelper_NoMalloc.h"
+#include "StaticDevice.h"
+#include "HeapAdvisor.h"
+#include "../SasCore/SasProfile.h"
+
+#define PROFILE_EPOCH 1735689600		// 2025-01-01T00:00:00Z, fixed so every --profile token is the same
+#ifdef SAS_HEAP_ADVISOR
+#define ADVISE_MARGIN 25				// Percent added to the smallest buffer by default
+#endif
+
+// The heap buffer. --advise works out the smallest that will do.
+#ifndef SAS_HEAP_BUFFER_SIZE
+#define SAS_HEAP_BUFFER_SIZE 2048
+#endif
 
 int usage();
+int profile(const char* count, const char* connectionString);
+int profileMint(void* context);
+#ifdef SAS_HEAP_ADVISOR
+int advise(const char* source, int marginPercent);
+int adviseOne(const char* connectionString, const char* name, int marginPercent, size_t* largest);
+#endif
+#ifdef SAS_DEVICE_CONNECTION_STRING
+int staticDevice();
+#endif
 
 int main(int argc, char** argv)
 {
+#ifdef SAS_DEVICE_CONNECTION_STRING
+	if (argc == 1)
+		return staticDevice();
+#endif
+
+	if (argc == 4 && 0 == strcmp(argv[1], "--profile"))
+		return profile(argv[2], argv[3]);
+
+#ifdef SAS_HEAP_ADVISOR
+	if ((argc == 3 || argc == 4) && 0 == strcmp(argv[1], "--advise"))
+		return advise(argv[2], argc == 4 ? atoi(argv[3]) : ADVISE_MARGIN);
+#endif
+
 	if (argc != 2)
 	{
 		printf("Missing or invalid arguments\r\n\n");
 		return usage();
 	}
 
-	unsigned char buffer[2048];
+	unsigned char buffer[SAS_HEAP_BUFFER_SIZE];
 
 	CONNECTIONSTRINGHANDLE csh = CreateConnectionStringHandle(*(++argv), buffer, sizeof(buffer));
 
@@ -48,9 +84,174 @@ int main(int argc, char** argv)
 	DestroyConnectionStringHandle(csh);
 }
 
+#ifdef SAS_DEVICE_CONNECTION_STRING
+// Use the device compiled into the program. Nothing is parsed and no heap is used.
+int staticDevice()
+{
+	char password[512];
+
+	if (generateStaticPassword(NULL, NULL, 3600, password, sizeof(password)) > (int)sizeof(password))
+		return 4;
+
+	printf("MQTT client id = %s\r\n", GetStaticDeviceId());
+	printf("MQTT user name = %s/%s\r\n", GetStaticDeviceHostName(), GetStaticDeviceId());
+	printf("MQTT server name = %s\r\n", GetStaticDeviceHostName());
+	printf("MQTT password = %s\r\n", password);
+
+	return 0;
+}
+#endif
+
+// Mint count tokens with a fixed clock and print what each one cost, and the
+// most of the heap that was in use at once
+int profile(const char* count, const char* connectionString)
+{
+	long iterations = atol(count);
+
+	if (iterations <= 0)
+	{
+		printf("Invalid iteration count %s\r\n\n", count);
+		return usage();
+	}
+
+	unsigned char buffer[SAS_HEAP_BUFFER_SIZE];
+
+	CONNECTIONSTRINGHANDLE csh = CreateConnectionStringHandle(connectionString, buffer, sizeof(buffer));
+
+	if (csh == NULL)
+		return 4;
+
+	int64_t now = PROFILE_EPOCH;
+	SASPROFILERESULT result;
+	HEAPINFO heapInfo = { 0 };
+
+	SetConnectionStringClock(csh, sasClockFixed, &now);
+
+	int rc = sasProfileRun(profileMint, csh, iterations, &result);
+
+	if (rc == 0)
+	{
+		sasProfilePrint(&result);
+		heapGetInfo(csh->hHeap, &heapInfo);
+		printf("%-18s %10d of %d bytes\r\n", "heap peak", heapInfo.peakUsedBytes, heapInfo.totalBytes);
+	}
+	else
+	{
+		printf("Unable to generate a token\r\n");
+	}
+
+	DestroyConnectionStringHandle(csh);
+
+	return rc == 0 ? 0 : 4;
+}
+
+// Mint one token for profile
+int profileMint(void* context)
+{
+	char password[512];
+	int length = generatePassword((CONNECTIONSTRINGHANDLE)context, 3600, password, sizeof(password));
+
+	// generatePassword counts the terminator, the profile reports the token text
+	return length > 0 ? length - 1 : -1;
+}
+
+#ifdef SAS_HEAP_ADVISOR
+// Work out the heap buffer size for a connection string, or for every one in
+// a file given as @file, one per line
+int advise(const char* source, int marginPercent)
+{
+	size_t largest = 0;
+	int count = 0;
+
+	if (marginPercent < 0)
+	{
+		printf("Invalid margin %d\r\n\n", marginPercent);
+		return usage();
+	}
+
+	if (source[0] != '@')
+	{
+		if (adviseOne(source, "connection string", marginPercent, &largest) != 0)
+			return 4;
+
+		count = 1;
+	}
+	else
+	{
+		FILE* input = fopen(source + 1, "r");
+
+		if (input == NULL)
+		{
+			printf("Unable to open %s\r\n", source + 1);
+			return 4;
+		}
+
+		char line[1024];
+		char name[32];
+		int lineNumber = 0;
+
+		while (fgets(line, sizeof(line), input) != NULL)
+		{
+			lineNumber++;
+			line[strcspn(line, "\r\n")] = '\0';
+
+			if (line[0] == '\0' || line[0] == '#')
+				continue;
+
+			snprintf(name, sizeof(name), "line %d", lineNumber);
+
+			if (adviseOne(line, name, marginPercent, &largest) != 0)
+			{
+				fclose(input);
+				return 4;
+			}
+
+			count++;
+		}
+
+		fclose(input);
+	}
+
+	if (count == 0)
+	{
+		printf("No connection strings\r\n");
+		return 4;
+	}
+
+	printf("\r\n#define SAS_HEAP_BUFFER_SIZE %d\t// Smallest working buffer for %d connection string%s plus %d%%\r\n",
+		(int)largest, count, count == 1 ? "" : "s", marginPercent);
+
+	return 0;
+}
+
+// Report on one connection string and keep the largest recommendation
+int adviseOne(const char* connectionString, const char* name, int marginPercent, size_t* largest)
+{
+	HEAPADVICE advice;
+
+	if (HeapAdviseConnectionString(connectionString, marginPercent, &advice) != 0)
+	{
+		printf("%s: does not parse and mint in any heap buffer\r\n", name);
+		return -1;
+	}
+
+	printf("%s: smallest buffer %d bytes (%d allocated at peak, %d headers and fragmentation), recommended %d\r\n",
+		name, (int)advice.smallestBuffer, advice.peakUsedBytes, advice.overheadBytes, (int)advice.recommendedBuffer);
+
+	if (advice.recommendedBuffer > *largest)
+		*largest = advice.recommendedBuffer;
+
+	return 0;
+}
+#endif
+
 int usage()
 {
-	printf("Usage: IoTSASTokenGenerate <deviceConnectionString>");
+	printf("Usage: IoTSASTokenGenerate <deviceConnectionString>\r\n");
+	printf("       IoTSASTokenGenerate --profile <count> <deviceConnectionString>");
+#ifdef SAS_HEAP_ADVISOR
+	printf("\r\n       IoTSASTokenGenerate --advise <deviceConnectionString | @file> [marginPercent]");
+#endif
 
 	return 4;
 }
@@ -0,0 +1,187 @@
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include "MultiHeap.h"
+
+#define MULTIHEAP_LINE 64					// Cache line size, so no two heaps share one
+#define MULTIHEAP_MAX_LENGTH UINT16_MAX		// The most heapInit takes
+#define MULTIHEAP_EMPTY UINT16_MAX			// End of a remote free queue
+
+typedef struct _SUBHEAP
+{
+	alignas(MULTIHEAP_LINE) HEAPHANDLE heap;
+
+	// Offset in heap of the last block another thread freed. Each queued
+	// block holds the offset of the one queued before it in its first bytes.
+	std::atomic<uint32_t> remoteFrees;
+} SUBHEAP;
+
+typedef struct _MULTIHEAP
+{
+	int heapCount;
+	size_t heapLength;
+	uint8_t* heapsStart;
+	SUBHEAP heaps[MULTIHEAP_MAX_HEAPS];
+} MULTIHEAP, * HMULTIHEAP;
+
+static SUBHEAP* multiHeapGetSubHeap(MULTIHEAPHANDLE hMulti, int heap);
+static void multiHeapQueueFree(SUBHEAP* sub, void* address);
+
+// Split the buffer into heapCount heaps
+MULTIHEAPHANDLE multiHeapInit(uint8_t* buffer, size_t bufferLen, int heapCount)
+{
+	if (buffer == NULL || heapCount < 1 || heapCount > MULTIHEAP_MAX_HEAPS)
+		return NULL;
+
+	size_t skip = (MULTIHEAP_LINE - ((uintptr_t)buffer & (MULTIHEAP_LINE - 1))) & (MULTIHEAP_LINE - 1);
+
+	if (bufferLen < skip + sizeof(MULTIHEAP))
+		return NULL;
+
+	size_t heapLength = ((bufferLen - skip - sizeof(MULTIHEAP)) / (size_t)heapCount) & ~(size_t)(MULTIHEAP_LINE - 1);
+
+	if (heapLength > MULTIHEAP_MAX_LENGTH)
+		heapLength = MULTIHEAP_MAX_LENGTH & ~(MULTIHEAP_LINE - 1);
+
+	HMULTIHEAP multi = new (buffer + skip) MULTIHEAP();
+
+	multi->heapCount = heapCount;
+	multi->heapLength = heapLength;
+	multi->heapsStart = buffer + skip + sizeof(MULTIHEAP);
+
+	for (int i = 0; i < heapCount; i++)
+	{
+		multi->heaps[i].heap = heapInit(multi->heapsStart + heapLength * (size_t)i, heapLength);
+		multi->heaps[i].remoteFrees.store(MULTIHEAP_EMPTY, std::memory_order_relaxed);
+
+		if (multi->heaps[i].heap == NULL)
+			return NULL;
+	}
+
+	return (MULTIHEAPHANDLE)multi;
+}
+
+// Allocate a block from the caller's heap
+void* multiHeapMalloc(MULTIHEAPHANDLE hMulti, int heap, size_t bytes)
+{
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, heap);
+
+	if (sub == NULL)
+		return NULL;
+
+	multiHeapCollect(hMulti, heap);
+
+	return heapMalloc(sub->heap, bytes);
+}
+
+// Allocate an aligned block from the caller's heap
+void* multiHeapMallocAligned(MULTIHEAPHANDLE hMulti, int heap, size_t bytes, size_t align)
+{
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, heap);
+
+	if (sub == NULL)
+		return NULL;
+
+	multiHeapCollect(hMulti, heap);
+
+	return heapMallocAligned(sub->heap, bytes, align);
+}
+
+// Free a block, or queue it for its owner if that is another heap
+void multiHeapFree(MULTIHEAPHANDLE hMulti, int heap, void* address)
+{
+	int owner = multiHeapGetOwner(hMulti, address);
+
+	if (owner < 0 || multiHeapGetSubHeap(hMulti, heap) == NULL)
+		return;
+
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, owner);
+
+	if (owner == heap)
+	{
+		multiHeapCollect(hMulti, heap);
+		heapFree(sub->heap, address);
+	}
+	else
+	{
+		multiHeapQueueFree(sub, address);
+	}
+}
+
+// Free the blocks other threads have queued for the caller's heap
+void multiHeapCollect(MULTIHEAPHANDLE hMulti, int heap)
+{
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, heap);
+
+	if (sub == NULL || sub->remoteFrees.load(std::memory_order_relaxed) == MULTIHEAP_EMPTY)
+		return;
+
+	uint32_t offset = sub->remoteFrees.exchange(MULTIHEAP_EMPTY, std::memory_order_acquire);
+
+	while (offset != MULTIHEAP_EMPTY)
+	{
+		uint8_t* address = (uint8_t*)sub->heap + offset;
+		uint16_t next;
+
+		memcpy(&next, address, sizeof(next));
+		heapFree(sub->heap, address);
+		offset = next;
+	}
+}
+
+// The heap an address was allocated from
+int multiHeapGetOwner(MULTIHEAPHANDLE hMulti, void* address)
+{
+	HMULTIHEAP multi = (HMULTIHEAP)hMulti;
+	uint8_t* p = (uint8_t*)address;
+
+	if (multi == NULL || p < multi->heapsStart || p >= multi->heapsStart + multi->heapLength * (size_t)multi->heapCount)
+		return -1;
+
+	return (int)((size_t)(p - multi->heapsStart) / multi->heapLength);
+}
+
+// The heap.c heap behind a heap number, for the caller's own use only
+HEAPHANDLE multiHeapGetHeap(MULTIHEAPHANDLE hMulti, int heap)
+{
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, heap);
+
+	return sub != NULL ? sub->heap : NULL;
+}
+
+// heapGetInfo for the caller's heap once queued frees are collected
+void multiHeapGetInfo(MULTIHEAPHANDLE hMulti, int heap, HEAPINFO* heapInfo)
+{
+	SUBHEAP* sub = multiHeapGetSubHeap(hMulti, heap);
+
+	if (sub == NULL)
+	{
+		memset(heapInfo, 0, sizeof(*heapInfo));
+		return;
+	}
+
+	multiHeapCollect(hMulti, heap);
+	heapGetInfo(sub->heap, heapInfo);
+}
+
+static SUBHEAP* multiHeapGetSubHeap(MULTIHEAPHANDLE hMulti, int heap)
+{
+	HMULTIHEAP multi = (HMULTIHEAP)hMulti;
+
+	return (multi != NULL && heap >= 0 && heap < multi->heapCount) ? &multi->heaps[heap] : NULL;
+}
+
+// Push a block onto its owner's queue, any thread may do this at any time
+static void multiHeapQueueFree(SUBHEAP* sub, void* address)
+{
+	uint32_t offset = (uint32_t)((uint8_t*)address - (uint8_t*)sub->heap);
+	uint32_t head = sub->remoteFrees.load(std::memory_order_relaxed);
+
+	do
+	{
+		uint16_t next = (uint16_t)head;
+
+		memcpy(address, &next, sizeof(next));
+	} while (!sub->remoteFrees.compare_exchange_weak(head, offset, std::memory_order_release, std::memory_order_relaxed));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "heap.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Sub-heaps one buffer can be split into
+#define MULTIHEAP_MAX_HEAPS 8
+
+typedef void* MULTIHEAPHANDLE;
+
+/*
+ * Several heaps over one buffer, for callers that allocate from more than one
+ * thread. The buffer is split into heapCount equal heap.c heaps of at most
+ * 65535 bytes each, and every function takes the caller's heap number, its
+ * core or task number. Only one thread may use a heap number at a time, so
+ * allocating and freeing its own blocks takes no lock.
+ *
+ * A block can be freed by any thread. One freed by a thread that does not
+ * own it is pushed onto a lock free queue of its owner's, and the owner
+ * frees it on its next multiHeapMalloc, multiHeapFree or multiHeapCollect.
+ * Blocks are not resized across heaps, use heapRealloc on the caller's own
+ * heap from multiHeapGetHeap.
+ */
+MULTIHEAPHANDLE multiHeapInit(uint8_t* buffer, size_t bufferLen, int heapCount);
+void* multiHeapMalloc(MULTIHEAPHANDLE hMulti, int heap, size_t bytes);
+void* multiHeapMallocAligned(MULTIHEAPHANDLE hMulti, int heap, size_t bytes, size_t align);
+void multiHeapFree(MULTIHEAPHANDLE hMulti, int heap, void* address);
+void multiHeapCollect(MULTIHEAPHANDLE hMulti, int heap);
+int multiHeapGetOwner(MULTIHEAPHANDLE hMulti, void* address);	// -1 if not in any heap
+HEAPHANDLE multiHeapGetHeap(MULTIHEAPHANDLE hMulti, int heap);
+void multiHeapGetInfo(MULTIHEAPHANDLE hMulti, int heap, HEAPINFO* heapInfo);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#include "../SasCore/DeviceIdentity.h"
+#include "StaticDevice.h"
+
+#ifdef SAS_DEVICE_CONNECTION_STRING
+
+static constexpr auto device = sas::compileDevice<SAS_DEVICE_CONNECTION_STRING>();
+
+const char* GetStaticDeviceHostName(void)
+{
+	return device.hostName;
+}
+
+const char* GetStaticDeviceId(void)
+{
+	return device.deviceId;
+}
+
+// Generate the SAS token for the compiled in device
+int generateStaticPassword(SASCLOCK clock, void* clockContext, long tokenTTL, char* output, int outputLen)
+{
+	if (clock == NULL)
+		clock = sasClockReal;
+
+	return device.generatePassword(clock(clockContext) + tokenTTL, output, outputLen);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../SasCore/SasClock.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * A device identity compiled into the program for firmware with a single
+ * connection string. Build with SAS_DEVICE_CONNECTION_STRING defined as the
+ * connection string literal. The compiler parses it, decodes the key and
+ * precomputes the HMAC key schedule. Neither the connection string nor the
+ * key is kept in the binary and no heap is used.
+ *
+ * generateStaticPassword follows generatePassword: it returns the length
+ * including the null terminator and only writes output if all of it fits.
+ * A null clock reads the system clock.
+ */
+#ifdef SAS_DEVICE_CONNECTION_STRING
+const char* GetStaticDeviceHostName(void);
+const char* GetStaticDeviceId(void);
+int generateStaticPassword(SASCLOCK clock, void* clockContext, long tokenTTL, char* output, int outputLen);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,22 +1,50 @@
 #include "heap.h"
 
-#ifdef _DEBUG_HEAP
+#ifdef _DEBUG_HEAP_CANARY
 #include <stdio.h>
+#include <stdlib.h>
+#endif
 
+#ifdef _DEBUG_HEAP
 #define _DEBUG_HEAP_SANITY(HEAP) (heapSanity(HEAP));
+#elif defined(_DEBUG_HEAP_INCREMENTAL)
+#define _DEBUG_HEAP_SANITY(HEAP) (heapCountOperation(HEAP))
 #else
 #define _DEBUG_HEAP_SANITY(HEAP) (0)
 #endif
 
+#ifdef _DEBUG_HEAP_INCREMENTAL
+#define _DEBUG_HEAP_CHECK_BLOCK(HEAP, MB) (heapCheckBlock(HEAP, MB))
+#else
+#define _DEBUG_HEAP_CHECK_BLOCK(HEAP, MB) ((void)0)
+#endif
+
+#ifdef _DEBUG_HEAP_CANARY
+#define _DEBUG_HEAP_SET_CANARY(HEAP, MB) ((MB)->canary = heapGetCanary(HEAP, MB))
+#else
+#define _DEBUG_HEAP_SET_CANARY(HEAP, MB) ((void)0)
+#endif
+
 #include <memory.h>
 
+#define SAS_TRACE_SEMAPHORES
+#include "../SasCore/SasTrace.h"
+
+SAS_TRACE_SEMAPHORE(heap_malloc);
+SAS_TRACE_SEMAPHORE(heap_free);
+SAS_TRACE_SEMAPHORE(heap_realloc);
+
 #define MIN_ALLOC sizeof(MEMORYBLOCKSTRUCT) + 4
 #define CHAIN_END UINT16_MAX
-#define MIN_BUFFER 1024
+#define MIN_BUFFER (sizeof(HHEAPSTRUCT) + sizeof(MEMORYBLOCKSTRUCT) + MIN_ALLOC)	// Room for one allocation
 #define MAX_BUFFER UINT16_MAX
+#define CANARY 0xa5c3
 
 typedef struct _MEMORYBLOCK
 {
+#ifdef _DEBUG_HEAP_CANARY
+	uint16_t canary;		// First, so an overrun of the block before hits it
+#endif
 	uint16_t length;
 	uint16_t next;
 	uint16_t previous;
@@ -26,6 +54,12 @@ typedef struct _HEAPHANDLE
 {
 	MEMORYBLOCKSTRUCT freeList;
 	MEMORYBLOCKSTRUCT usedList;
+	uint16_t usedBytes;
+	uint16_t peakUsedBytes;
+#ifdef _DEBUG_HEAP_CANARY
+	uint16_t bufferLength;
+	uint16_t operations;
+#endif
 } HHEAPSTRUCT, * HHEAP;
 
 MEMORYBLOCK heapGetFreeList(HEAPHANDLE hHeap);
@@ -37,10 +71,22 @@ MEMORYBLOCK heapGetMB(uint8_t* address);
 uint8_t* heapGetData(MEMORYBLOCK mb);
 void heapInsertIntoFreeList(HEAPHANDLE hHead, MEMORYBLOCK mb);
 void heapInsertAfter(HEAPHANDLE hHeap, MEMORYBLOCK target, MEMORYBLOCK newItem);
+void heapAddUsed(HEAPHANDLE hHeap, int bytes);
 void heapRemoveFromList(HEAPHANDLE hHeap, MEMORYBLOCK mb);
 int heapGetIsAdjacent(MEMORYBLOCK first, MEMORYBLOCK second);
+int heapGetFreeBytes(HEAPHANDLE hHeap);
+size_t heapGetAlignmentPad(uint8_t* data, size_t align);
 static void* heapTruncate(HEAPHANDLE hHeap, void* address, uint16_t newLength);
 static void* heapExtend(HEAPHANDLE hHeap, void* address, uint16_t newLength);
+#ifdef _DEBUG_HEAP_CANARY
+uint16_t heapGetCanary(HEAPHANDLE hHeap, MEMORYBLOCK mb);
+int heapCheckBlock(HEAPHANDLE hHeap, MEMORYBLOCK mb);
+int heapCountOperation(HEAPHANDLE hHeap);
+int heapCorrupt(HEAPHANDLE hHeap, MEMORYBLOCK mb, const char* reason);
+static void heapDefaultCorruptionHandler(HEAPHANDLE hHeap, uint16_t offset, const char* reason);
+
+static HEAPCORRUPTIONHANDLER corruptionHandler = heapDefaultCorruptionHandler;
+#endif
 
 // Initialize the heap structures
 HEAPHANDLE heapInit(uint8_t *buffer, size_t bufferLen)
@@ -60,12 +106,21 @@ HEAPHANDLE heapInit(uint8_t *buffer, size_t bufferLen)
 	hHeap->freeList.length = 1;
 	hHeap->freeList.next = (uint16_t)sizeof(HHEAPSTRUCT);
 	hHeap->freeList.previous = CHAIN_END;
+	hHeap->usedBytes = 0;
+	hHeap->peakUsedBytes = 0;
+#ifdef _DEBUG_HEAP_CANARY
+	hHeap->bufferLength = (uint16_t)bufferLen;
+	hHeap->operations = 0;
+#endif
+	_DEBUG_HEAP_SET_CANARY(hHeap, &hHeap->usedList);
+	_DEBUG_HEAP_SET_CANARY(hHeap, &hHeap->freeList);
 
 	MEMORYBLOCK first = heapGetNextAddress(hHeap, &hHeap->freeList);
 
 	first->length = (uint16_t)(bufferLen - sizeof(HHEAPSTRUCT) - sizeof(MEMORYBLOCKSTRUCT));
 	first->next = CHAIN_END;
 	first->previous = (uint16_t)((uint8_t*)&hHeap->freeList - buffer);
+	_DEBUG_HEAP_SET_CANARY(hHeap, first);
 
 	_DEBUG_HEAP_SANITY(hHeap);
 
@@ -106,6 +161,7 @@ void* heapMalloc(HEAPHANDLE hHeap, size_t bytes)
 					heapGetNextAddress(hHeap, add)->previous = heapGetOffset(hHeap, add);
 
 				add->length = mb->length - sizeof(MEMORYBLOCKSTRUCT) - (uint16_t)bytes;
+				_DEBUG_HEAP_SET_CANARY(hHeap, add);
 				mb->length = (uint16_t)bytes;
 			}
 			else
@@ -114,6 +170,8 @@ void* heapMalloc(HEAPHANDLE hHeap, size_t bytes)
 			}
 
 			heapInsertAfter(hHeap, heapGetUsedList(hHeap), mb);
+			heapAddUsed(hHeap, mb->length);
+			_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
 
 			result = heapGetData(mb);
 		}
@@ -121,6 +179,78 @@ void* heapMalloc(HEAPHANDLE hHeap, size_t bytes)
 
 	_DEBUG_HEAP_SANITY(hHeap);
 
+	if (SAS_TRACE_ENABLED(heap_malloc))
+		SAS_TRACE3(heap_malloc, bytes, result, heapGetFreeBytes(hHeap));
+
+	return result;
+}
+
+// Allocate a block whose address is a multiple of align, a power of two.
+// The padding in front of it is split off into a free block of its own.
+void* heapMallocAligned(HEAPHANDLE hHeap, size_t bytes, size_t align)
+{
+	void* result = NULL;
+
+	if (align <= 2)
+		return heapMalloc(hHeap, bytes);
+
+	if (hHeap != NULL && bytes != 0 && (align & (align - 1)) == 0 && align < MAX_BUFFER)
+	{
+		if (bytes % 2 != 0)
+			bytes += 1;
+
+		if (bytes < MIN_ALLOC - sizeof(MEMORYBLOCKSTRUCT))
+			bytes = MIN_ALLOC - sizeof(MEMORYBLOCKSTRUCT);
+
+		MEMORYBLOCK mb = heapGetFreeList(hHeap);
+		size_t pad = 0;
+
+		while (NULL != (mb = heapGetNextAddress(hHeap, mb)))
+		{
+			pad = heapGetAlignmentPad(heapGetData(mb), align);
+
+			if (mb->length >= pad + bytes)
+				break;
+		}
+
+		if (mb != NULL)
+		{
+			heapRemoveFromList(hHeap, mb);
+
+			if (pad != 0)
+			{
+				MEMORYBLOCK lead = mb;
+
+				mb = (MEMORYBLOCK)(heapGetData(lead) + pad - sizeof(MEMORYBLOCKSTRUCT));
+				mb->length = (uint16_t)(lead->length - pad);
+				_DEBUG_HEAP_SET_CANARY(hHeap, mb);
+				lead->length = (uint16_t)(pad - sizeof(MEMORYBLOCKSTRUCT));
+				heapInsertIntoFreeList(hHeap, lead);
+			}
+
+			if (mb->length - bytes > MIN_ALLOC)
+			{
+				MEMORYBLOCK trailer = (MEMORYBLOCK)(heapGetData(mb) + bytes);
+
+				trailer->length = mb->length - sizeof(MEMORYBLOCKSTRUCT) - (uint16_t)bytes;
+				_DEBUG_HEAP_SET_CANARY(hHeap, trailer);
+				mb->length = (uint16_t)bytes;
+				heapInsertIntoFreeList(hHeap, trailer);
+			}
+
+			heapInsertAfter(hHeap, heapGetUsedList(hHeap), mb);
+			heapAddUsed(hHeap, mb->length);
+			_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
+
+			result = heapGetData(mb);
+		}
+	}
+
+	_DEBUG_HEAP_SANITY(hHeap);
+
+	if (SAS_TRACE_ENABLED(heap_malloc))
+		SAS_TRACE3(heap_malloc, bytes, result, heapGetFreeBytes(hHeap));
+
 	return result;
 }
 
@@ -131,7 +261,9 @@ void heapFree(HEAPHANDLE hHeap, void* address)
 	{
 		MEMORYBLOCK mb = heapGetMB(address);
 
+		_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
 		heapRemoveFromList(hHeap, mb);
+		heapAddUsed(hHeap, -(int)mb->length);
 
 		MEMORYBLOCK search = heapGetNextAddress(hHeap, heapGetFreeList(hHeap));
 
@@ -164,83 +296,34 @@ void heapFree(HEAPHANDLE hHeap, void* address)
 		}
 
 		heapInsertIntoFreeList(hHeap, mb);
+		_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
 	}
 
 	_DEBUG_HEAP_SANITY(hHeap);
+
+	if (SAS_TRACE_ENABLED(heap_free))
+		SAS_TRACE2(heap_free, address, heapGetFreeBytes(hHeap));
 }
 
 void* heapRealloc(HEAPHANDLE hHeap, void* address, uint16_t newLength)
 {
+	void* result = NULL;
+
 	if (hHeap != NULL && address != NULL)
 	{
 		MEMORYBLOCK mb = heapGetMB(address);
 
-		return mb->length > newLength
+		_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
+
+		result = mb->length > newLength
 			? heapTruncate(hHeap, address, newLength)
 			: mb->length < newLength
 			? heapExtend(hHeap, address, newLength)
 			: address;
 	}
-	else
-	{
-		return NULL;
-	}
-}
 
-static void* heapTruncate(HEAPHANDLE hHeap, void* address, uint16_t newLength)
-{
-	void* result = NULL;
-
-	if (hHeap != NULL && address != NULL)
-	{
-		if (newLength == 0)
-		{
-			heapFree(hHeap, address);
-		}
-		else
-		{
-			if (newLength % 2 != 0)
-				newLength += 1;
-
-			MEMORYBLOCK mb = heapGetMB(address);
-
-			if (newLength == mb->length)
-			{
-				result = address;
-			}
-			else if (newLength < mb->length)
-			{
-				result = address;
-
-				MEMORYBLOCK search = heapGetNextAddress(hHeap, heapGetFreeList(hHeap));
-
-				while (search != NULL)
-				{
-					if (1 == heapGetIsAdjacent(search, mb))
-						break;
-
-					search = heapGetNextAddress(hHeap, search);
-				}
-
-				if (search != NULL || mb->length - newLength > MIN_ALLOC)
-				{
-					MEMORYBLOCK trailer = (MEMORYBLOCK)((uint8_t*)address + newLength);
-					trailer->length = mb->length - newLength - sizeof(MEMORYBLOCKSTRUCT);
-					mb->length = newLength;
-
-					if (search != NULL)
-					{
-						heapRemoveFromList(hHeap, search);
-						trailer->length += (search->length + sizeof(MEMORYBLOCKSTRUCT));
-					}
-
-					heapInsertIntoFreeList(hHeap, trailer);
-				}
-			}
-		}
-	}
-
-	_DEBUG_HEAP_SANITY(hHeap);
+	if (SAS_TRACE_ENABLED(heap_realloc))
+		SAS_TRACE4(heap_realloc, address, (size_t)newLength, result, heapGetFreeBytes(hHeap));
 
 	return result;
 }
@@ -284,6 +367,7 @@ static void* heapTruncate(HEAPHANDLE hHeap, void* address, uint16_t newLength)
 				{
 					MEMORYBLOCK trailer = (MEMORYBLOCK)((uint8_t*)address + newLength);
 					trailer->length = mb->length - newLength - sizeof(MEMORYBLOCKSTRUCT);
+					heapAddUsed(hHeap, (int)newLength - (int)mb->length);
 					mb->length = newLength;
 
 					if (search != NULL)
@@ -292,7 +376,10 @@ static void* heapTruncate(HEAPHANDLE hHeap, void* address, uint16_t newLength)
 						trailer->length += (search->length + sizeof(MEMORYBLOCKSTRUCT));
 					}
 
+					// After search is unlinked, a small truncation puts trailer over its header
+					_DEBUG_HEAP_SET_CANARY(hHeap, trailer);
 					heapInsertIntoFreeList(hHeap, trailer);
+					_DEBUG_HEAP_CHECK_BLOCK(hHeap, trailer);
 				}
 			}
 		}
@@ -338,6 +425,8 @@ static void* heapExtend(HEAPHANDLE hHeap, void* address, uint16_t newLength)
 				MEMORYBLOCK newFree = (MEMORYBLOCK)(heapGetData(mb) + newLength);
 
 				newFree->length = search->length - (newLength - mb->length);
+				_DEBUG_HEAP_SET_CANARY(hHeap, newFree);
+				heapAddUsed(hHeap, (int)newLength - (int)mb->length);
 				mb->length = newLength;
 
 				if (newFree->length > 0)
@@ -345,6 +434,8 @@ static void* heapExtend(HEAPHANDLE hHeap, void* address, uint16_t newLength)
 					heapInsertIntoFreeList(hHeap, newFree);
 					result = address;
 				}
+
+				_DEBUG_HEAP_CHECK_BLOCK(hHeap, mb);
 			}
 			else
 			{
@@ -377,20 +468,49 @@ void heapGetInfo(HEAPHANDLE hHeap, HEAPINFO *heapInfo)
 	
 	while (NULL != (mb = heapGetNextAddress(hHeap, mb)))
 	{
-		heapInfo->totalBytes += mb->length + sizeof(MEMORYBLOCKSTRUCT);
-		heapInfo->usedBytes += mb->length;
+		totalBytes += mb->length + sizeof(MEMORYBLOCKSTRUCT);
+		usedBytes += mb->length;
 	}
 
 	mb = heapGetFreeList(hHeap);
 
 	while (NULL != (mb = heapGetNextAddress(hHeap, mb)))
 	{
-		heapInfo->totalBytes += mb->length + sizeof(MEMORYBLOCKSTRUCT);
-		heapInfo->freeBytes += mb->length;
+		totalBytes += mb->length + sizeof(MEMORYBLOCKSTRUCT);
+		freeBytes += mb->length;
 
-		if (mb->length > heapInfo->largestFree)
-			heapInfo->largestFree = mb->length;
+		if (mb->length > largestFree)
+			largestFree = mb->length;
 	}
+
+	heapInfo->freeBytes = freeBytes;
+	heapInfo->usedBytes = usedBytes;
+	heapInfo->totalBytes = totalBytes;
+	heapInfo->largestFree = largestFree;
+	heapInfo->peakUsedBytes = ((HHEAP)hHeap)->peakUsedBytes;
+}
+
+// Start measuring the peak again from what is in use now
+void heapResetPeak(HEAPHANDLE hHeap)
+{
+	if (hHeap != NULL)
+		((HHEAP)hHeap)->peakUsedBytes = ((HHEAP)hHeap)->usedBytes;
+}
+
+// Total of the free blocks, only worked out for tracing
+int heapGetFreeBytes(HEAPHANDLE hHeap)
+{
+	int freeBytes = 0;
+
+	if (hHeap != NULL)
+	{
+		MEMORYBLOCK mb = heapGetFreeList(hHeap);
+
+		while (NULL != (mb = heapGetNextAddress(hHeap, mb)))
+			freeBytes += mb->length;
+	}
+
+	return freeBytes;
 }
 
 #ifdef _DEBUG_HEAP
@@ -432,6 +552,136 @@ void heapSanity(HEAPHANDLE hHeap)
 	printf("         free bytes = %05d\n", freeBytes);
 	printf("         used bytes = %05d\n", usedBytes);
 	printf(" largest free block = %05d\n", largestFree);
+
+	heapCheck(hHeap);
+}
+#endif
+
+#ifdef _DEBUG_HEAP_CANARY
+// Replace the corruption handler, NULL restores the default
+void heapSetCorruptionHandler(HEAPCORRUPTIONHANDLER handler)
+{
+	corruptionHandler = (handler != NULL) ? handler : heapDefaultCorruptionHandler;
+}
+
+// Check the whole heap: every block in address order, then both lists
+int heapCheck(HEAPHANDLE hHeap)
+{
+	HHEAP heap = (HHEAP)hHeap;
+	uint16_t offset = (uint16_t)sizeof(HHEAPSTRUCT);
+	int blocks = 0;
+	int listed = 0;
+	int usedBytes = 0;
+
+	while (offset < heap->bufferLength)
+	{
+		MEMORYBLOCK mb = (MEMORYBLOCK)((uint8_t*)hHeap + offset);
+
+		if (offset > heap->bufferLength - sizeof(MEMORYBLOCKSTRUCT) || mb->canary != heapGetCanary(hHeap, mb))
+			return heapCorrupt(hHeap, mb, "block header overwritten");
+
+		if (offset + sizeof(MEMORYBLOCKSTRUCT) + mb->length > heap->bufferLength)
+			return heapCorrupt(hHeap, mb, "block runs past the end of the heap");
+
+		offset = (uint16_t)(offset + sizeof(MEMORYBLOCKSTRUCT) + mb->length);
+		blocks++;
+	}
+
+	for (MEMORYBLOCK list = heapGetUsedList(hHeap); list != NULL; list = (list == heapGetUsedList(hHeap)) ? heapGetFreeList(hHeap) : NULL)
+	{
+		MEMORYBLOCK mb = list;
+
+		while (NULL != (mb = heapGetNextAddress(hHeap, mb)))
+		{
+			if (++listed > blocks)
+				return heapCorrupt(hHeap, list, "list loops");
+
+			if (heapCheckBlock(hHeap, mb) != 0)
+				return -1;
+
+			if (list == heapGetUsedList(hHeap))
+				usedBytes += mb->length;
+		}
+	}
+
+	if (listed != blocks)
+		return heapCorrupt(hHeap, heapGetFreeList(hHeap), "block missing from the lists");
+
+	if (usedBytes != heap->usedBytes)
+		return heapCorrupt(hHeap, heapGetUsedList(hHeap), "used byte count wrong");
+
+	return 0;
+}
+
+// Check a block a call touched: its canary, its list links and the canary
+// of the block after it in memory, which is where an overrun of it lands
+int heapCheckBlock(HEAPHANDLE hHeap, MEMORYBLOCK mb)
+{
+	HHEAP heap = (HHEAP)hHeap;
+	uint16_t offset = heapGetOffset(hHeap, mb);
+
+	if (offset < sizeof(HHEAPSTRUCT) || offset > heap->bufferLength - sizeof(MEMORYBLOCKSTRUCT))
+		return heapCorrupt(hHeap, mb, "block outside the heap");
+
+	if (mb->canary != heapGetCanary(hHeap, mb))
+		return heapCorrupt(hHeap, mb, "block header overwritten");
+
+	if (offset + sizeof(MEMORYBLOCKSTRUCT) + mb->length > heap->bufferLength)
+		return heapCorrupt(hHeap, mb, "block runs past the end of the heap");
+
+	if (mb->previous >= heap->bufferLength || heapGetPreviousAddress(hHeap, mb)->next != offset)
+		return heapCorrupt(hHeap, mb, "previous link broken");
+
+	if (mb->next != CHAIN_END && (mb->next >= heap->bufferLength || heapGetNextAddress(hHeap, mb)->previous != offset))
+		return heapCorrupt(hHeap, mb, "next link broken");
+
+	MEMORYBLOCK after = (MEMORYBLOCK)(heapGetData(mb) + mb->length);
+
+	if (heapGetOffset(hHeap, after) < heap->bufferLength && after->canary != heapGetCanary(hHeap, after))
+		return heapCorrupt(hHeap, after, "overrun into the next block");
+
+	return 0;
+}
+
+// Count a call and check the whole heap every _DEBUG_HEAP_SWEEP calls
+int heapCountOperation(HEAPHANDLE hHeap)
+{
+#if defined(_DEBUG_HEAP_SWEEP) && _DEBUG_HEAP_SWEEP > 0
+	HHEAP heap = (HHEAP)hHeap;
+
+	if (heap != NULL && ++heap->operations >= _DEBUG_HEAP_SWEEP)
+	{
+		heap->operations = 0;
+		return heapCheck(hHeap);
+	}
+#else
+	(void)hHeap;
+#endif
+
+	return 0;
+}
+
+// The canary for a block header, different at every offset so a header
+// copied or shifted to the wrong place does not pass either
+inline uint16_t heapGetCanary(HEAPHANDLE hHeap, MEMORYBLOCK mb)
+{
+	return (uint16_t)(heapGetOffset(hHeap, mb) ^ CANARY);
+}
+
+// Report corruption
+int heapCorrupt(HEAPHANDLE hHeap, MEMORYBLOCK mb, const char* reason)
+{
+	corruptionHandler(hHeap, heapGetOffset(hHeap, mb), reason);
+
+	return -1;
+}
+
+static void heapDefaultCorruptionHandler(HEAPHANDLE hHeap, uint16_t offset, const char* reason)
+{
+	(void)hHeap;
+
+	printf("Heap corrupt at offset %d: %s\r\n", offset, reason);
+	abort();
 }
 #endif
 
@@ -506,6 +756,29 @@ void heapInsertAfter(HEAPHANDLE hHeap, MEMORYBLOCK target, MEMORYBLOCK newItem)
 		heapGetNextAddress(hHeap, newItem)->previous = heapGetOffset(hHeap, newItem);
 }
 
+// Account for bytes joining (or with a negative count leaving) the used list
+void heapAddUsed(HEAPHANDLE hHeap, int bytes)
+{
+	HHEAP heap = (HHEAP)hHeap;
+
+	heap->usedBytes = (uint16_t)(heap->usedBytes + bytes);
+
+	if (heap->usedBytes > heap->peakUsedBytes)
+		heap->peakUsedBytes = heap->usedBytes;
+}
+
+// Bytes from data to the first multiple of align that leaves room for a
+// free block in front, 0 if data is already aligned
+size_t heapGetAlignmentPad(uint8_t* data, size_t align)
+{
+	size_t pad = (align - ((uintptr_t)data & (align - 1))) & (align - 1);
+
+	while (pad != 0 && pad < MIN_ALLOC)
+		pad += align;
+
+	return pad;
+}
+
 // Remove mb from the list within which it resides
 void heapRemoveFromList(HEAPHANDLE hHeap, MEMORYBLOCK mb)
 {
@@ -1,10 +1,17 @@
 #pragma once
 
 //#define _DEBUG_HEAP
+//#define _DEBUG_HEAP_INCREMENTAL
+//#define _DEBUG_HEAP_SWEEP 64
 
 #include <stdint.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 typedef void* HEAPHANDLE;
 
 typedef struct _HEAPINFO
@@ -13,15 +20,41 @@ typedef struct _HEAPINFO
 	int usedBytes;
 	int totalBytes;
 	int largestFree;
+	int peakUsedBytes;		// Most usedBytes has been since heapInit or heapResetPeak
 } HEAPINFO;
 
 HEAPHANDLE heapInit(uint8_t *buffer, size_t bufferLen);
 void* heapMalloc(HEAPHANDLE hHeap, size_t bytes);
+void* heapMallocAligned(HEAPHANDLE hHeap, size_t bytes, size_t align);	// align a power of two, kept by heapRealloc only in place
 void heapFree(HEAPHANDLE hHeap, void* address);
 void* heapRealloc(HEAPHANDLE hHeap, void* address, uint16_t newLength);
 void heapGetInfo(HEAPHANDLE hHeap, HEAPINFO *heapInfo);
+void heapResetPeak(HEAPHANDLE hHeap);
 
 #ifdef _DEBUG_HEAP
 void heapSanity(HEAPHANDLE hHeap);
 #endif
 
+/*
+ * Corruption checks. _DEBUG_HEAP prints the whole heap after every call.
+ * _DEBUG_HEAP_INCREMENTAL is fast enough to leave on in soak tests: every
+ * block header carries a canary made from its offset and each call checks
+ * only the blocks it touched, their list neighbours and the header that
+ * follows them, which is where an overrun lands. _DEBUG_HEAP_SWEEP N adds a
+ * heapCheck of the whole heap every N calls.
+ *
+ * Corruption is reported to the handler, which by default prints it and
+ * aborts. heapCheck returns 0 or -1 once the handler returns.
+ */
+#if defined(_DEBUG_HEAP) || defined(_DEBUG_HEAP_INCREMENTAL)
+#define _DEBUG_HEAP_CANARY
+
+typedef void (*HEAPCORRUPTIONHANDLER)(HEAPHANDLE hHeap, uint16_t offset, const char* reason);
+
+void heapSetCorruptionHandler(HEAPCORRUPTIONHANDLER handler);
+int heapCheck(HEAPHANDLE hHeap);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
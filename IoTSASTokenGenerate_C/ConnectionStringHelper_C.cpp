@@ -0,0 +1,123 @@
+#include <string.h>
+#ifdef _DEBUG
+#include <stdio.h>
+#endif
+
+#include "../SasCore/SasCore.h"
+#include "../SasCore/SasTrace.h"
+#include "ConnectionStringHelper_C.h"
+
+/*
+ * The C interface over the shared core. These functions only adapt argument
+ * conventions, the work is done by the SasCore templates instantiated with
+ * the C runtime heap. Allocations are counted for the --profile report.
+ */
+typedef sas::CountingAllocator<sas::MallocAllocator> Allocator;
+
+CONNECTIONSTRINGHANDLE CreateConnectionStringHandle(const char* connectionString)
+{
+	if (connectionString == NULL)
+		return NULL;
+
+	Allocator allocator;
+	CONNECTIONSTRINGHANDLE h = (CONNECTIONSTRINGHANDLE)allocator.allocate(sizeof(CONNECTIONSTRINGSTRUCT));
+
+	if (h == NULL)
+		return h;
+
+	memset(h, 0, sizeof(*h));
+	h->clock = sasClockReal;
+
+	if (!sas::buildKeywordTable(connectionString, allocator, h->tokenCount, h->keywords, h->values))
+	{
+		allocator.deallocate(h, sizeof(*h));
+		return NULL;
+	}
+
+#ifdef _DEBUG
+	printf("Found %d tokens\r\n", h->tokenCount);
+
+	for (int i = 0; i < h->tokenCount; i++)
+	{
+		printf("keyword=%s;value=%s\r\n", h->keywords[i], h->values[i]);
+	}
+#endif
+
+	return h;
+}
+
+int DestroyConnectionStringHandle(CONNECTIONSTRINGHANDLE h)
+{
+	if (h != NULL)
+	{
+		Allocator allocator;
+
+		sas::freeKeywordTable(allocator, h->tokenCount, h->keywords, h->values, h->tokenCount);
+		allocator.deallocate(h, sizeof(*h));
+	}
+
+	return 0;
+}
+
+// Replace the clock used to calculate token expiry times
+void SetConnectionStringClock(CONNECTIONSTRINGHANDLE h, SASCLOCK clock, void* clockContext)
+{
+	h->clock = (clock != NULL) ? clock : sasClockReal;
+	h->clockContext = clockContext;
+}
+
+// Return the value for a keyword in the connection string
+const char* GetKeywordValue(CONNECTIONSTRINGHANDLE h, const char* keyword)
+{
+	if (keyword == NULL)
+		return NULL;
+
+	return sas::findKeywordValue(h->tokenCount, h->keywords, h->values, keyword);
+}
+
+// Encode a URL
+int urlEncode(const char* urlIn, char* urlOut, int urlOutLen)
+{
+	sas::BufferOutput out(urlOut, urlOutLen > 0 ? (size_t)urlOutLen : 0);
+
+	sas::urlEncode(urlIn, out);
+	out.put('\0');
+
+	return (int)out.count();
+}
+
+// Encodes the input into Base64
+int encodeBase64(const char *input, int inputLength, char *output, int outputLength)
+{
+	sas::BufferOutput out(output, outputLength > 0 ? (size_t)outputLength : 0);
+
+	sas::encodeBase64((const uint8_t*)input, inputLength > 0 ? (size_t)inputLength : 0, out);
+	out.put('\0');
+
+	return (int)out.count();
+}
+
+// Decodes from Base64
+int decodeBase64(const char* input, char* output, int outputLength)
+{
+	if (input == NULL)
+		return -1;
+
+	return (int)sas::decodeBase64(input, (uint8_t*)output, outputLength > 0 ? (size_t)outputLength : 0);
+}
+
+// Generate the SAS token for the IoT Hub
+int generatePassword(CONNECTIONSTRINGHANDLE h, long tokenTTL, char* output, int outputLen)
+{
+	Allocator allocator;
+	const char* deviceId = GetKeywordValue(h, "deviceid");
+
+	SAS_TRACE2(mint_start, deviceId, (int64_t)tokenTTL);
+
+	int result = sas::mintPassword(allocator, GetKeywordValue(h, "hostname"), deviceId, GetKeywordValue(h, "SharedAccessKey"),
+		h->clock(h->clockContext) + tokenTTL, output, outputLen);
+
+	SAS_TRACE3(mint_end, deviceId, (int64_t)tokenTTL, result);
+
+	return result;
+}
@@ -1,21 +1,35 @@
 #pragma once
 
+#include "../SasCore/SasClock.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 typedef struct _CONNECTIONSTRINGSTRUCT
 {
 	int tokenCount;
 	char** keywords;
 	char** values;
+	SASCLOCK clock;
+	void* clockContext;
 } CONNECTIONSTRINGSTRUCT, *CONNECTIONSTRINGHANDLE;
 
 CONNECTIONSTRINGHANDLE CreateConnectionStringHandle(const char* connectionString);
 const char* GetKeywordValue(CONNECTIONSTRINGHANDLE, const char* keyword);
 int DestroyConnectionStringHandle(CONNECTIONSTRINGHANDLE hcs);
+void SetConnectionStringClock(CONNECTIONSTRINGHANDLE h, SASCLOCK clock, void* clockContext);
 
 int urlEncode(const char* urlIn, char* urlOut, int urlOutLen);
 int encodeBase64(const char* input, int inputLength, char* output, int outputLength);
 int decodeBase64(const char* input, char* output, int outputLength);
 int generatePassword(CONNECTIONSTRINGHANDLE h, long tokenTTL, char* output, int outputLen);
 
+#ifdef __cplusplus
+}
+#endif
+
 
 /*
 class ConnectionStringHelper
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../SasCore/SasCore.h"
+#include "GroupEnrollment.h"
+
+namespace
+{
+	// The output and counts of one thread's share of a block
+	struct Share
+	{
+		std::string_view lines;
+		std::string output;
+		uint64_t devices = 0;
+		uint64_t skipped = 0;
+	};
+
+	void deriveShare(Share& share, const struct hmacSha256& groupKeyed, std::string_view hostName, int64_t tokenExpiry)
+	{
+		sas::StringOutput<std::string> out(share.output);
+
+		sas::forEachLine(share.lines, [&](std::string_view registrationId)
+		{
+			while (!registrationId.empty() && (registrationId.back() == '\r' || registrationId.back() == ' ' || registrationId.back() == '\t'))
+				registrationId.remove_suffix(1);
+
+			if (registrationId.empty())
+				return;
+
+			if (registrationId.length() > sas::REGISTRY_ID_LENGTH)
+			{
+				share.skipped++;
+				return;
+			}
+
+			sas::writeEnrollment(out, groupKeyed, registrationId, hostName, tokenExpiry);
+			out.put('\n');
+			share.devices++;
+		});
+	}
+}
+
+int DeriveGroupEnrollment(FILE* input, FILE* output, const char* groupKey, const char* hostName, long tokenTTL, SASCLOCK clock, void* clockContext, int threadCount, GROUPENROLLMENTSTATS* stats)
+{
+	struct hmacSha256 groupKeyed;
+
+	if (input == NULL || output == NULL || groupKey == NULL || !sas::initGroupKey(groupKeyed, groupKey))
+		return -1;
+
+	if (threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+
+	if (threadCount <= 0)
+		threadCount = 1;
+
+	char* buffer = (char*)malloc(GROUPENROLLMENT_BUFFER_SIZE);
+
+	if (buffer == NULL)
+		return -1;
+
+	if (clock == NULL)
+		clock = sasClockReal;
+
+	int64_t tokenExpiry = clock(clockContext) + tokenTTL;
+	std::string_view host = (hostName != NULL) ? hostName : "";
+	std::vector<Share> shares((size_t)threadCount);
+	std::vector<std::thread> threads;
+	uint64_t devices = 0;
+	uint64_t skipped = sas::forEachLineBlock(buffer, GROUPENROLLMENT_BUFFER_SIZE,
+		[input](char* to, size_t length) { return fread(to, 1, length, input); },
+		[&](std::string_view block)
+		{
+			// Split the block into roughly equal runs of whole lines
+			size_t shareLength = block.length() / shares.size() + 1;
+
+			for (Share& share : shares)
+			{
+				size_t length = block.find('\n', shareLength < block.length() ? shareLength - 1 : block.length());
+
+				length = (length == std::string_view::npos) ? block.length() : length + 1;
+				share.lines = block.substr(0, length);
+				share.output.clear();
+				block.remove_prefix(length);
+			}
+
+			for (size_t i = 1; i < shares.size(); i++)
+			{
+				if (!shares[i].lines.empty())
+					threads.emplace_back(deriveShare, std::ref(shares[i]), std::cref(groupKeyed), host, tokenExpiry);
+			}
+
+			deriveShare(shares[0], groupKeyed, host, tokenExpiry);
+
+			for (std::thread& thread : threads)
+				thread.join();
+
+			threads.clear();
+
+			for (Share& share : shares)
+				fwrite(share.output.data(), 1, share.output.length(), output);
+		});
+
+	free(buffer);
+
+	for (Share& share : shares)
+	{
+		devices += share.devices;
+		skipped += share.skipped;
+	}
+
+	if (stats != NULL)
+	{
+		stats->devices = devices;
+		stats->skipped = skipped;
+	}
+
+	return ferror(input) ? -1 : 0;
+}
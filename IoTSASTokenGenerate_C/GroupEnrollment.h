@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../SasCore/SasClock.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Read size for the registration ids, also the longest line accepted
+#define GROUPENROLLMENT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct _GROUPENROLLMENTSTATS
+{
+	uint64_t devices;
+	uint64_t skipped;
+} GROUPENROLLMENTSTATS;
+
+/*
+ * Derives the device keys of a DPS symmetric key group enrollment. Reads one
+ * registration id per line from input and writes "<registrationId> <deviceKey>"
+ * lines to output in the same order. If hostName is not NULL each line also
+ * gets a token for the hub device DPS will create, expiring tokenTTL seconds
+ * after the clock is read at the start. Each buffer of ids is split across
+ * threadCount threads, or one per core if threadCount is 0. Blank lines are
+ * ignored and ids longer than 128 characters are skipped. Returns 0, or -1 if
+ * the group key is not valid, the buffer could not be allocated or input had
+ * a read error.
+ */
+int DeriveGroupEnrollment(FILE* input, FILE* output, const char* groupKey, const char* hostName, long tokenTTL, SASCLOCK clock, void* clockContext, int threadCount, GROUPENROLLMENTSTATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
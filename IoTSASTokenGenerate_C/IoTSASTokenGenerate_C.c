@@ -2,13 +2,47 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ConnectionStringHelper_C.h"
+#include "TokenCacheFile.h"
+#include "RegistryImport.h"
+#include "GroupEnrollment.h"
+#include "../SasCore/SasProfile.h"
+
+#define PROFILE_EPOCH 1735689600		// 2025-01-01T00:00:00Z, fixed so every --profile token is the same
 
 int usage();
+int importRegistry(const char* exportFile, const char* hostName);
+int deriveGroup(const char* groupKey, const char* hostName);
+int profile(const char* count, const char* connectionString);
+int profileMint(void* context);
 
 int main(int argc, char** argv)
 {
-	if (argc != 2)
+	TOKENCACHEFILEHANDLE hc = NULL;
+
+	if (argc == 4 && 0 == strcmp(argv[1], "--import"))
+	{
+		return importRegistry(argv[2], argv[3]);
+	}
+	else if ((argc == 3 || argc == 4) && 0 == strcmp(argv[1], "--derive"))
+	{
+		return deriveGroup(argv[2], argc == 4 ? argv[3] : NULL);
+	}
+	else if (argc == 4 && 0 == strcmp(argv[1], "--profile"))
+	{
+		return profile(argv[2], argv[3]);
+	}
+	else if (argc == 4 && 0 == strcmp(argv[1], "--cache"))
+	{
+		hc = OpenTokenCacheFile(argv[2], TOKENCACHEFILE_DEFAULT_SLOTS);
+
+		if (hc == NULL)
+			printf("Unable to open token cache %s - continuing without it\r\n", argv[2]);
+
+		argv += 2;
+	}
+	else if (argc != 2)
 	{
 		printf("Missing or invalid arguments\r\n\n");
 		return usage();
@@ -30,7 +64,7 @@ int main(int argc, char** argv)
 	// SAS tokens are not a fixed size. It is possible that the new SAS token
 	// will be longer than the previous estimate. Keep increasing the buffer
 	// until it fits.
-	while (saveLen < (passwordLen = generatePassword(csh, 3600, password, saveLen)))
+	while (saveLen < (passwordLen = generatePasswordCached(csh, hc, 3600, password, saveLen)))
 	{
 		free(password);
 		password = (char*)malloc(passwordLen);
@@ -44,11 +78,97 @@ int main(int argc, char** argv)
 
 	free(password);
 	DestroyConnectionStringHandle(csh);
+	CloseTokenCacheFile(hc);
+}
+
+// Mint tokens for every device in a registry export, "-" reads standard input
+int importRegistry(const char* exportFile, const char* hostName)
+{
+	FILE* input = (0 == strcmp(exportFile, "-")) ? stdin : fopen(exportFile, "rb");
+
+	if (input == NULL)
+	{
+		printf("Unable to open registry export %s\r\n", exportFile);
+		return 4;
+	}
+
+	REGISTRYIMPORTSTATS stats;
+	int result = ImportDeviceRegistry(input, stdout, hostName, 3600, NULL, NULL, &stats);
+
+	if (input != stdin)
+		fclose(input);
+
+	fprintf(stderr, "Read %llu records, minted %llu tokens, skipped %llu\r\n",
+		(unsigned long long)stats.lines, (unsigned long long)stats.devices, (unsigned long long)stats.skipped);
+
+	return result == 0 ? 0 : 4;
+}
+
+// Derive group enrollment device keys for the registration ids on standard input
+int deriveGroup(const char* groupKey, const char* hostName)
+{
+	GROUPENROLLMENTSTATS stats;
+
+	if (0 != DeriveGroupEnrollment(stdin, stdout, groupKey, hostName, 3600, NULL, NULL, 0, &stats))
+	{
+		fprintf(stderr, "Invalid group key or unable to read registration ids\r\n");
+		return 4;
+	}
+
+	fprintf(stderr, "Derived %llu device keys, skipped %llu\r\n", (unsigned long long)stats.devices, (unsigned long long)stats.skipped);
+
+	return 0;
+}
+
+// Mint count tokens with a fixed clock and print what each one cost
+int profile(const char* count, const char* connectionString)
+{
+	long iterations = atol(count);
+
+	if (iterations <= 0)
+	{
+		printf("Invalid iteration count %s\r\n\n", count);
+		return usage();
+	}
+
+	CONNECTIONSTRINGHANDLE csh = CreateConnectionStringHandle(connectionString);
+
+	if (csh == NULL)
+		return 4;
+
+	int64_t now = PROFILE_EPOCH;
+	SASPROFILERESULT result;
+
+	SetConnectionStringClock(csh, sasClockFixed, &now);
+
+	int rc = sasProfileRun(profileMint, csh, iterations, &result);
+
+	if (rc == 0)
+		sasProfilePrint(&result);
+	else
+		printf("Unable to generate a token\r\n");
+
+	DestroyConnectionStringHandle(csh);
+
+	return rc == 0 ? 0 : 4;
+}
+
+// Mint one token for profile
+int profileMint(void* context)
+{
+	char password[512];
+	int length = generatePassword((CONNECTIONSTRINGHANDLE)context, 3600, password, sizeof(password));
+
+	// generatePassword counts the terminator, the profile reports the token text
+	return length > 0 ? length - 1 : -1;
 }
 
 int usage()
 {
-	printf("Usage: IoTSASTokenGenerate <deviceConnectionString>");
+	printf("Usage: IoTSASTokenGenerate [--cache <cacheFile>] <deviceConnectionString>\r\n");
+	printf("       IoTSASTokenGenerate --import <registryExportFile> <hostName>\r\n");
+	printf("       IoTSASTokenGenerate --derive <groupKey> [hostName] < registrationIds\r\n");
+	printf("       IoTSASTokenGenerate --profile <count> <deviceConnectionString>");
 
 	return 4;
 }
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+
+#include "../SasCore/SasCore.h"
+#include "RegistryImport.h"
+
+namespace
+{
+	// Output policy over stdio, which does its own buffering
+	class FileOutput
+	{
+	private:
+		FILE* _file;
+
+	public:
+		FileOutput(FILE* file) : _file(file) {}
+
+		void put(char c) { putc(c, _file); }
+		void write(const char* p, size_t len) { fwrite(p, 1, len, _file); }
+	};
+}
+
+int ImportDeviceRegistry(FILE* input, FILE* output, const char* hostName, long tokenTTL, SASCLOCK clock, void* clockContext, REGISTRYIMPORTSTATS* stats)
+{
+	if (input == NULL || output == NULL || hostName == NULL)
+		return -1;
+
+	char* buffer = (char*)malloc(REGISTRYIMPORT_BUFFER_SIZE);
+
+	if (buffer == NULL)
+		return -1;
+
+	if (clock == NULL)
+		clock = sasClockReal;
+
+	int64_t tokenExpiry = clock(clockContext) + tokenTTL;
+	FileOutput out(output);
+
+	sas::RegistryImportStats result = sas::importRegistry(buffer, REGISTRYIMPORT_BUFFER_SIZE,
+		[input](char* to, size_t length) { return fread(to, 1, length, input); },
+		[&](const sas::RegistryDevice& device)
+		{
+			sas::RegistryIdentity identity;
+
+			if (!sas::decodeRegistryDevice(device, identity))
+				return false;
+
+			sas::DeviceResource resource = identity.resource(hostName);
+
+			sas::writeString(out, identity.id());
+			out.put(' ');
+			sas::writeToken(out, resource, sas::signToken(identity.keyed, resource, tokenExpiry));
+			out.put('\n');
+
+			return true;
+		});
+
+	free(buffer);
+
+	if (stats != NULL)
+	{
+		stats->lines = result.lines;
+		stats->devices = result.devices;
+		stats->skipped = result.skipped;
+	}
+
+	return ferror(input) ? -1 : 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../SasCore/SasClock.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Read size for the export. This is all the memory an import uses and the
+// longest line it accepts.
+#define REGISTRYIMPORT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct _REGISTRYIMPORTSTATS
+{
+	uint64_t lines;
+	uint64_t devices;
+	uint64_t skipped;
+} REGISTRYIMPORTSTATS;
+
+/*
+ * Mints a token for every device in an IoT hub bulk export (JSON lines) read
+ * from input and writes "<deviceId> <token>" lines to output. Devices without
+ * a symmetric key and lines that are not JSON are counted as skipped. Every
+ * token expires tokenTTL seconds after the clock is read at the start.
+ * Returns 0, or -1 if the buffer could not be allocated or input had a read
+ * error.
+ */
+int ImportDeviceRegistry(FILE* input, FILE* output, const char* hostName, long tokenTTL, SASCLOCK clock, void* clockContext, REGISTRYIMPORTSTATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
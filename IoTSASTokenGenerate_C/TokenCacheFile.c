@@ -0,0 +1,510 @@
+#include <string.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#endif
+#include "../SasCore/sha256.h"
+#include "../SasCore/SasClock.h"
+#define SAS_TRACE_SEMAPHORES
+#include "../SasCore/SasTrace.h"
+#include "TokenCacheFile.h"
+
+#define TOKENCACHEFILE_MAGIC 0x43544153		// "SATC"
+#define TOKENCACHEFILE_VERSION 2
+#define PROBE_LENGTH 8
+#define MAX_READ_RETRIES 1000
+#define SPIN_RETRIES 64						// Retries that spin before the rest yield
+#define STALE_CLAIM_SECONDS 5				// A writer holds a slot for microseconds, older claims are from dead writers
+
+SAS_TRACE_SEMAPHORE(cache_hit);
+SAS_TRACE_SEMAPHORE(cache_miss);
+
+// The slots are shared with other processes so the sequence numbers must be
+// accessed atomically. The token text is copied with plain reads and writes
+// and validated by re-reading the sequence number.
+#ifdef _WIN32
+#define LOAD_ACQUIRE(p) ((uint32_t)InterlockedCompareExchange((volatile LONG*)(p), 0, 0))
+#define STORE_RELEASE(p, v) (InterlockedExchange((volatile LONG*)(p), (LONG)(v)))
+#define LOAD_ACQUIRE64(p) ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(p), 0, 0))
+#define STORE_RELEASE64(p, v) (InterlockedExchange64((volatile LONG64*)(p), (LONG64)(v)))
+#define COMPARE_AND_SWAP(p, expected, desired) ((uint32_t)InterlockedCompareExchange((volatile LONG*)(p), (LONG)(desired), (LONG)(expected)) == (expected))
+#define MEMORY_FENCE() MemoryBarrier()
+#else
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE64(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE64(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define COMPARE_AND_SWAP(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define MEMORY_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#if defined(_WIN32)
+#define CPU_RELAX() YieldProcessor()
+#define THREAD_YIELD() SwitchToThread()
+#else
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define CPU_RELAX() ((void)0)
+#endif
+#define THREAD_YIELD() sched_yield()
+#endif
+
+typedef struct _CACHEHEADER
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+	uint8_t reserved[48];
+} CACHEHEADER;
+
+typedef struct _CACHESLOT
+{
+	uint32_t sequence;
+	uint32_t length;
+	uint64_t keyHi;
+	uint64_t keyLo;
+	int64_t expiry;
+	uint64_t claim;			// Odd sequence number of the last claim and when it was made, see stampClaim
+	char token[TOKENCACHEFILE_TOKEN_LENGTH];
+} CACHESLOT;
+
+typedef struct _TOKENCACHEFILESTRUCT
+{
+	CACHEHEADER* header;
+	CACHESLOT* slots;
+	uint32_t mask;
+	size_t mapLength;
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#else
+	int fd;
+#endif
+} TOKENCACHEFILESTRUCT;
+
+static int initializeMapping(TOKENCACHEFILEHANDLE hc, int slotCount);
+static void stampClaim(CACHESLOT* slot, uint32_t sequence, int64_t now);
+static int reclaimStaleSlot(CACHESLOT* slot, uint32_t sequence, int64_t now);
+static void backoff(int retries);
+
+// Open or create the cache file and map it into memory
+TOKENCACHEFILEHANDLE OpenTokenCacheFile(const char* fileName, int slotCount)
+{
+	if (fileName == NULL)
+		return NULL;
+
+	int slots = PROBE_LENGTH;
+
+	while (slots < slotCount)
+		slots <<= 1;
+
+	TOKENCACHEFILEHANDLE hc = (TOKENCACHEFILEHANDLE)malloc(sizeof(TOKENCACHEFILESTRUCT));
+
+	if (hc == NULL)
+		return NULL;
+
+	memset(hc, 0, sizeof(*hc));
+	hc->mapLength = sizeof(CACHEHEADER) + (size_t)slots * sizeof(CACHESLOT);
+
+#ifdef _WIN32
+	hc->hFile = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (hc->hFile == INVALID_HANDLE_VALUE)
+	{
+		free(hc);
+		return NULL;
+	}
+
+	OVERLAPPED overlapped;
+	LARGE_INTEGER fileSize;
+
+	memset(&overlapped, 0, sizeof(overlapped));
+	LockFileEx(hc->hFile, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped);
+
+	if (GetFileSizeEx(hc->hFile, &fileSize) && fileSize.QuadPart != 0)
+		hc->mapLength = (size_t)fileSize.QuadPart;
+
+	hc->hMapping = CreateFileMappingA(hc->hFile, NULL, PAGE_READWRITE, (DWORD)((uint64_t)hc->mapLength >> 32), (DWORD)hc->mapLength, NULL);
+
+	if (hc->hMapping != NULL)
+		hc->header = (CACHEHEADER*)MapViewOfFile(hc->hMapping, FILE_MAP_ALL_ACCESS, 0, 0, hc->mapLength);
+
+	int result = (hc->header != NULL)
+		? initializeMapping(hc, slots)
+		: -1;
+
+	UnlockFileEx(hc->hFile, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+	struct stat st;
+
+	hc->fd = open(fileName, O_RDWR | O_CREAT, 0600);
+
+	if (hc->fd == -1)
+	{
+		free(hc);
+		return NULL;
+	}
+
+	// Serialize creation with any other process opening the file
+	flock(hc->fd, LOCK_EX);
+
+	int result = fstat(hc->fd, &st);
+
+	if (result == 0)
+	{
+		if (st.st_size == 0)
+			result = ftruncate(hc->fd, (off_t)hc->mapLength);
+		else
+			hc->mapLength = (size_t)st.st_size;
+	}
+
+	if (result == 0)
+	{
+		void* map = mmap(NULL, hc->mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, hc->fd, 0);
+
+		if (map != MAP_FAILED)
+		{
+			hc->header = (CACHEHEADER*)map;
+			result = initializeMapping(hc, slots);
+		}
+		else
+		{
+			result = -1;
+		}
+	}
+
+	flock(hc->fd, LOCK_UN);
+#endif
+
+	if (result != 0)
+	{
+		CloseTokenCacheFile(hc);
+		hc = NULL;
+	}
+
+	return hc;
+}
+
+// Unmap and close the cache file
+void CloseTokenCacheFile(TOKENCACHEFILEHANDLE hc)
+{
+	if (hc != NULL)
+	{
+#ifdef _WIN32
+		if (hc->header != NULL)
+			UnmapViewOfFile(hc->header);
+
+		if (hc->hMapping != NULL)
+			CloseHandle(hc->hMapping);
+
+		CloseHandle(hc->hFile);
+#else
+		if (hc->header != NULL)
+			munmap(hc->header, hc->mapLength);
+
+		close(hc->fd);
+#endif
+		free(hc);
+	}
+}
+
+// Builds the digest that identifies a connection string. Only a hash of the
+// shared access key is used so the key cannot be recovered from the file.
+TOKENCACHEKEY TokenCacheFileMakeKey(CONNECTIONSTRINGHANDLE h)
+{
+	static const char* keywords[] = { "hostname", "deviceid", "moduleid", "SharedAccessKey" };
+
+	struct sha256 s;
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	TOKENCACHEKEY key = { 0, 0 };
+
+	sha256Init(&s);
+
+	for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+	{
+		const char* value = GetKeywordValue(h, keywords[i]);
+
+		if (value == NULL)
+			value = "";
+
+		sha256Update(&s, value, (unsigned long)strlen(value) + 1);
+	}
+
+	sha256Sum(&s, digest);
+
+	for (int i = 0; i < 8; i++)
+	{
+		key.hi = (key.hi << 8) | digest[i];
+		key.lo = (key.lo << 8) | digest[i + 8];
+	}
+
+	return key;
+}
+
+// Copy the token for key into output if it is valid until at least minExpiry.
+// Returns the length of the token including the terminator or zero if there
+// is no usable token.
+int TokenCacheFileLookup(TOKENCACHEFILEHANDLE hc, TOKENCACHEKEY key, int64_t minExpiry, char* output, int outputLen)
+{
+	char token[TOKENCACHEFILE_TOKEN_LENGTH];
+
+	for (uint32_t probe = 0; probe < PROBE_LENGTH; probe++)
+	{
+		CACHESLOT* slot = &hc->slots[((uint32_t)key.lo + probe) & hc->mask];
+
+		for (int retries = 0; retries < MAX_READ_RETRIES; retries++)
+		{
+			uint32_t sequence = LOAD_ACQUIRE(&slot->sequence);
+
+			// A writer is updating the slot or died while doing so
+			if (sequence & 1)
+			{
+				if (!reclaimStaleSlot(slot, sequence, sasClockReal(NULL)))
+					backoff(retries);
+
+				continue;
+			}
+
+			uint32_t length = slot->length;
+			int match = length != 0 && slot->keyHi == key.hi && slot->keyLo == key.lo;
+			int64_t expiry = slot->expiry;
+			int valid = match && expiry >= minExpiry && length <= TOKENCACHEFILE_TOKEN_LENGTH;
+
+			if (valid)
+				memcpy(token, slot->token, length);
+
+			MEMORY_FENCE();
+
+			if (LOAD_ACQUIRE(&slot->sequence) != sequence)
+			{
+				backoff(retries);
+				continue;
+			}
+
+			if (valid)
+			{
+				if (output != NULL && outputLen > (int)length)
+				{
+					memcpy(output, token, length);
+					output[length] = '\0';
+				}
+
+				return (int)length + 1;
+			}
+
+			if (match)
+				return 0;
+
+			break;
+		}
+	}
+
+	return 0;
+}
+
+// Store a token in the cache. Replaces the slot already holding key, an empty
+// or expired slot or the slot that expires soonest in that order. Slots that
+// another writer holds are skipped.
+void TokenCacheFileStore(TOKENCACHEFILEHANDLE hc, TOKENCACHEKEY key, int64_t expiry, int64_t now, const char* token)
+{
+	size_t length = strlen(token);
+
+	if (length == 0 || length > TOKENCACHEFILE_TOKEN_LENGTH)
+		return;
+
+	CACHESLOT* victim = NULL;
+	int64_t victimExpiry = INT64_MAX;
+	int victimFree = 0;
+	int64_t wallClock = sasClockReal(NULL);
+
+	for (uint32_t probe = 0; probe < PROBE_LENGTH; probe++)
+	{
+		CACHESLOT* slot = &hc->slots[((uint32_t)key.lo + probe) & hc->mask];
+		uint32_t sequence = LOAD_ACQUIRE(&slot->sequence);
+
+		if ((sequence & 1) && !reclaimStaleSlot(slot, sequence, wallClock))
+			continue;
+
+		if (slot->length != 0 && slot->keyHi == key.hi && slot->keyLo == key.lo)
+		{
+			victim = slot;
+			break;
+		}
+
+		if (victimFree)
+			continue;
+
+		if (slot->length == 0 || slot->expiry <= now)
+		{
+			victim = slot;
+			victimFree = 1;
+		}
+		else if (slot->expiry < victimExpiry)
+		{
+			victim = slot;
+			victimExpiry = slot->expiry;
+		}
+	}
+
+	if (victim == NULL)
+		return;
+
+	uint32_t sequence = LOAD_ACQUIRE(&victim->sequence);
+
+	if (sequence & 1)
+		return;
+
+	if (!COMPARE_AND_SWAP(&victim->sequence, sequence, sequence + 1))
+		return;
+
+	stampClaim(victim, sequence + 1, wallClock);
+	MEMORY_FENCE();
+
+	memcpy(victim->token, token, length);
+	victim->keyHi = key.hi;
+	victim->keyLo = key.lo;
+	victim->expiry = expiry;
+	victim->length = (uint32_t)length;
+
+	// Only publish if the slot is still ours. A writer that stalled for longer
+	// than STALE_CLAIM_SECONDS has had it reclaimed and must drop the token.
+	COMPARE_AND_SWAP(&victim->sequence, sequence + 1, sequence + 2);
+}
+
+// Generate the SAS token for the IoT Hub or reuse one that this or another
+// process put into the cache file. A cached token is reused while at least
+// half of tokenTTL remains before it expires.
+int generatePasswordCached(CONNECTIONSTRINGHANDLE h, TOKENCACHEFILEHANDLE hc, long tokenTTL, char* output, int outputLen)
+{
+	if (hc == NULL)
+		return generatePassword(h, tokenTTL, output, outputLen);
+
+	int64_t epoch = h->clock(h->clockContext);
+	TOKENCACHEKEY key = TokenCacheFileMakeKey(h);
+	int result = TokenCacheFileLookup(hc, key, epoch + tokenTTL / 2, output, outputLen);
+
+	if (result > 0)
+	{
+		if (SAS_TRACE_ENABLED(cache_hit))
+			SAS_TRACE2(cache_hit, GetKeywordValue(h, "deviceid"), (int64_t)tokenTTL);
+
+		return result;
+	}
+
+	if (SAS_TRACE_ENABLED(cache_miss))
+		SAS_TRACE2(cache_miss, GetKeywordValue(h, "deviceid"), (int64_t)tokenTTL);
+
+	char token[TOKENCACHEFILE_TOKEN_LENGTH + 1];
+
+	result = generatePassword(h, tokenTTL, token, sizeof(token));
+
+	if (result > (int)sizeof(token))
+		return generatePassword(h, tokenTTL, output, outputLen);	// Too long to cache
+
+	if (result < 0)
+		return result;
+
+	TokenCacheFileStore(hc, key, epoch + tokenTTL, epoch, token);
+
+	if (output != NULL && outputLen >= result)
+		memcpy(output, token, result);
+
+	return result;
+}
+
+// Set up a freshly created file or validate one that already exists
+static int initializeMapping(TOKENCACHEFILEHANDLE hc, int slotCount)
+{
+	CACHEHEADER* header = hc->header;
+
+	if (header->magic == 0)
+	{
+		if (hc->mapLength < sizeof(CACHEHEADER) + (size_t)slotCount * sizeof(CACHESLOT))
+			return -1;
+
+		// New file - the slots are already zero filled
+		header->version = TOKENCACHEFILE_VERSION;
+		header->slotCount = (uint32_t)slotCount;
+		header->slotSize = sizeof(CACHESLOT);
+		MEMORY_FENCE();
+		header->magic = TOKENCACHEFILE_MAGIC;
+	}
+	else if (header->magic != TOKENCACHEFILE_MAGIC ||
+		header->version != TOKENCACHEFILE_VERSION ||
+		header->slotSize != sizeof(CACHESLOT) ||
+		header->slotCount < PROBE_LENGTH ||
+		(header->slotCount & (header->slotCount - 1)) != 0 ||
+		hc->mapLength < sizeof(CACHEHEADER) + (size_t)header->slotCount * sizeof(CACHESLOT))
+	{
+		return -1;
+	}
+
+	hc->slots = (CACHESLOT*)(header + 1);
+	hc->mask = header->slotCount - 1;
+
+	// Free slots left claimed by writers that died, so they are not probed past
+	// until the next lookup or store happens to land on them
+	int64_t now = sasClockReal(NULL);
+
+	for (uint32_t i = 0; i <= hc->mask; i++)
+	{
+		uint32_t sequence = LOAD_ACQUIRE(&hc->slots[i].sequence);
+
+		if (sequence & 1)
+			reclaimStaleSlot(&hc->slots[i], sequence, now);
+	}
+
+	return 0;
+}
+
+// Record when the claim that made the slot's sequence odd was made. Only the
+// owner of the claim writes this, after its compare and swap succeeded. The
+// sequence number goes in with the time so a stamp left by an earlier claim is
+// never taken for the current one's.
+static void stampClaim(CACHESLOT* slot, uint32_t sequence, int64_t now)
+{
+	STORE_RELEASE64(&slot->claim, ((uint64_t)sequence << 32) | (uint32_t)now);
+}
+
+// Take over a slot a writer claimed more than STALE_CLAIM_SECONDS ago and leave
+// it empty. The sequence moves on by two so it stays odd while the slot is
+// cleared and only one of several processes doing this succeeds. A claim that
+// is not stamped yet is never stale. Returns 1 if the slot was reclaimed.
+static int reclaimStaleSlot(CACHESLOT* slot, uint32_t sequence, int64_t now)
+{
+	uint64_t claim = LOAD_ACQUIRE64(&slot->claim);
+	int32_t age = (int32_t)((uint32_t)now - (uint32_t)claim);
+
+	if ((uint32_t)(claim >> 32) != sequence || (age <= STALE_CLAIM_SECONDS && age >= -STALE_CLAIM_SECONDS))
+		return 0;
+
+	if (!COMPARE_AND_SWAP(&slot->sequence, sequence, sequence + 2))
+		return 0;
+
+	stampClaim(slot, sequence + 2, now);
+	MEMORY_FENCE();
+	slot->length = 0;
+
+	return COMPARE_AND_SWAP(&slot->sequence, sequence + 2, sequence + 3);
+}
+
+// Wait before re-reading a slot a writer holds, spinning at first then
+// giving up the processor
+static void backoff(int retries)
+{
+	if (retries < SPIN_RETRIES)
+		CPU_RELAX();
+	else
+		THREAD_YIELD();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ConnectionStringHelper_C.h"
+
+// Tokens longer than this are not cached
+#define TOKENCACHEFILE_TOKEN_LENGTH 256
+#define TOKENCACHEFILE_DEFAULT_SLOTS 1024
+
+typedef struct _TOKENCACHEKEY
+{
+	uint64_t hi;
+	uint64_t lo;
+} TOKENCACHEKEY;
+
+typedef struct _TOKENCACHEFILESTRUCT* TOKENCACHEFILEHANDLE;
+
+/*
+ * The cache file is a fixed size hash table that any number of processes can
+ * map at the same time. Each slot holds one finished SAS token, its expiry time
+ * and a digest that identifies the connection string it was minted from. The
+ * shared access key itself is never written to the file but the tokens are
+ * valid credentials, so the file is created readable by its owner only.
+ */
+TOKENCACHEFILEHANDLE OpenTokenCacheFile(const char* fileName, int slotCount);
+void CloseTokenCacheFile(TOKENCACHEFILEHANDLE hc);
+
+TOKENCACHEKEY TokenCacheFileMakeKey(CONNECTIONSTRINGHANDLE h);
+int TokenCacheFileLookup(TOKENCACHEFILEHANDLE hc, TOKENCACHEKEY key, int64_t minExpiry, char* output, int outputLen);
+void TokenCacheFileStore(TOKENCACHEFILEHANDLE hc, TOKENCACHEKEY key, int64_t expiry, int64_t now, const char* token);
+
+int generatePasswordCached(CONNECTIONSTRINGHANDLE h, TOKENCACHEFILEHANDLE hc, long tokenTTL, char* output, int outputLen);
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+
+/*
+ * Allocator policies. A policy has void *allocate(size_t) returning null on
+ * failure and void deallocate(void*, size_t) taking the size that was asked
+ * for. The core is templated on the policy so there is no indirect call.
+ */
+namespace sas
+{
+	// The C runtime heap
+	struct MallocAllocator
+	{
+		void *allocate(size_t bytes) { return malloc(bytes); }
+		void deallocate(void *p, size_t) { free(p); }
+	};
+
+	// Any C allocator that takes a handle, such as the heap.c heap used by
+	// the NoMalloc build. The functions are template arguments so the calls
+	// are direct.
+	template <class Handle, void *(*Allocate)(Handle, size_t), void (*Free)(Handle, void *)>
+	class HandleAllocator
+	{
+	private:
+		Handle _handle;
+
+	public:
+		HandleAllocator(Handle handle) : _handle(handle) {}
+
+		void *allocate(size_t bytes) { return Allocate(_handle, bytes); }
+		void deallocate(void *p, size_t) { Free(_handle, p); }
+		Handle handle() const { return _handle; }
+	};
+
+	// Allocations made through CountingAllocator and CountingResource on the
+	// calling thread
+	struct AllocationCounts
+	{
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+	};
+
+	inline AllocationCounts &allocationCounts()
+	{
+		static thread_local AllocationCounts counts;
+
+		return counts;
+	}
+
+	// Any other policy, counting what it hands out into allocationCounts
+	template <class Inner>
+	class CountingAllocator : public Inner
+	{
+	public:
+		using Inner::Inner;
+
+		void *allocate(size_t bytes)
+		{
+			void *p = Inner::allocate(bytes);
+
+			if (p != nullptr)
+			{
+				AllocationCounts &counts = allocationCounts();
+
+				counts.allocations++;
+				counts.bytes += bytes;
+			}
+
+			return p;
+		}
+	};
+
+	// Bump allocator over storage inside the object, for use on the stack.
+	// Only the most recent allocation is given back by deallocate, anything
+	// else is released when the allocator goes out of scope.
+	template <size_t Size>
+	class StackAllocator
+	{
+	private:
+		alignas(max_align_t) uint8_t _storage[Size];
+		size_t _used = 0;
+
+		static constexpr size_t roundUp(size_t bytes) { return (bytes + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1); }
+
+	public:
+		StackAllocator() {}
+		StackAllocator(const StackAllocator &) = delete;
+		StackAllocator &operator=(const StackAllocator &) = delete;
+
+		void *allocate(size_t bytes)
+		{
+			size_t rounded = roundUp(bytes);
+
+			if (rounded < bytes || rounded > Size - _used)
+				return nullptr;
+
+			void *p = _storage + _used;
+
+			_used += rounded;
+
+			return p;
+		}
+
+		void deallocate(void *p, size_t bytes)
+		{
+			if (p != nullptr && (uint8_t *)p + roundUp(bytes) == _storage + _used)
+				_used -= roundUp(bytes);
+		}
+
+		size_t used() const { return _used; }
+	};
+
+#if __has_include(<memory_resource>)
+	// A std::pmr memory resource. The resource must outlive the allocations.
+	class PmrAllocator
+	{
+	private:
+		std::pmr::memory_resource *_resource;
+
+	public:
+		PmrAllocator(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : _resource(resource) {}
+
+		void *allocate(size_t bytes)
+		{
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+			try
+			{
+				return _resource->allocate(bytes, alignof(max_align_t));
+			}
+			catch (const std::bad_alloc &)
+			{
+				return nullptr;
+			}
+#else
+			return _resource->allocate(bytes, alignof(max_align_t));
+#endif
+		}
+
+		void deallocate(void *p, size_t bytes) { if (p != nullptr) _resource->deallocate(p, bytes, alignof(max_align_t)); }
+		std::pmr::memory_resource *resource() const { return _resource; }
+	};
+
+	// A memory resource that counts into allocationCounts and passes
+	// everything on to upstream
+	class CountingResource : public std::pmr::memory_resource
+	{
+	private:
+		std::pmr::memory_resource *_upstream;
+
+		void *do_allocate(size_t bytes, size_t alignment) override
+		{
+			void *p = _upstream->allocate(bytes, alignment);
+			AllocationCounts &counts = allocationCounts();
+
+			counts.allocations++;
+			counts.bytes += bytes;
+
+			return p;
+		}
+
+		void do_deallocate(void *p, size_t bytes, size_t alignment) override { _upstream->deallocate(p, bytes, alignment); }
+		bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+	public:
+		CountingResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) : _upstream(upstream) {}
+	};
+#endif
+}
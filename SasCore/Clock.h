@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Clock policies for token expiry times. A clock is any type with an int64_t
+ * now() method returning seconds since the Unix epoch. The value is 64 bits
+ * so expiry times survive 2038. The C clocks in SasClock.h wrap these.
+ */
+namespace sas
+{
+	// Constrains templates taking a clock, so a non-clock argument picks
+	// another overload instead of failing inside the template
+	template <class T>
+	concept ClockPolicy = requires(const T &clock) { { clock.now() } -> std::convertible_to<int64_t>; };
+
+	// Reads the system clock on every call
+	struct RealClock
+	{
+		int64_t now() const
+		{
+			return (int64_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+	};
+
+	// Reads the cheaper coarse system clock where there is one
+	inline int64_t readCoarseClock()
+	{
+#ifdef CLOCK_REALTIME_COARSE
+		struct timespec ts;
+
+		clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+		return (int64_t)ts.tv_sec;
+#else
+		return RealClock().now();
+#endif
+	}
+
+	// Reads the system clock only when refreshed. Refresh once per batch of tokens
+	// instead of making a clock call per token.
+	class CoarseClock
+	{
+	private:
+		int64_t _now;
+
+	public:
+		CoarseClock() { refresh(); }
+
+		void refresh() { _now = readCoarseClock(); }
+		int64_t now() const { return _now; }
+	};
+
+	// Always returns the same time. Use for reproducible tokens in tests and benchmarks.
+	class FixedClock
+	{
+	private:
+		int64_t _now;
+
+	public:
+		FixedClock(int64_t now) : _now(now) {}
+
+		void set(int64_t now) { _now = now; }
+		int64_t now() const { return _now; }
+	};
+}
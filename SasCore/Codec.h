@@ -0,0 +1,254 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Profile.h"
+
+/*
+ * Output policies and the Base64 and URL codecs. An output policy is any type
+ * with put(char) and write(const char*, size_t). The codecs are templates on
+ * the policy so each build gets code specialized for where its output goes.
+ */
+namespace sas
+{
+	// Counts the characters written without storing them
+	class CountingOutput
+	{
+	private:
+		size_t _count = 0;
+
+	public:
+		constexpr void put(char) { _count++; }
+		constexpr void write(const char *, size_t len) { _count += len; }
+		constexpr size_t count() const { return _count; }
+	};
+
+	// Writes into a fixed size buffer. Characters past the end are counted but
+	// not stored so count() is always the length the output needed.
+	class BufferOutput
+	{
+	private:
+		char *_buffer;
+		size_t _capacity;
+		size_t _count = 0;
+
+	public:
+		constexpr BufferOutput(char *buffer, size_t capacity) : _buffer(buffer), _capacity(buffer != nullptr ? capacity : 0) {}
+
+		constexpr void put(char c)
+		{
+			if (_count < _capacity)
+				_buffer[_count] = c;
+
+			_count++;
+		}
+
+		constexpr void write(const char *p, size_t len)
+		{
+			for (size_t i = 0; i < len; i++)
+				put(p[i]);
+		}
+
+		constexpr size_t count() const { return _count; }
+		constexpr bool overflowed() const { return _count > _capacity; }
+	};
+
+	// Appends to any string type with push_back and append
+	template <class String>
+	class StringOutput
+	{
+	private:
+		String &_string;
+
+	public:
+		StringOutput(String &string) : _string(string) {}
+
+		void put(char c) { _string.push_back(c); }
+		void write(const char *p, size_t len) { _string.append(p, len); }
+	};
+
+	template <class Output>
+	constexpr void writeString(Output &out, std::string_view s)
+	{
+		out.write(s.data(), s.length());
+	}
+
+	inline constexpr char BASE64_CODES[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
+	inline constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+
+	namespace detail
+	{
+		// Reverse of BASE64_CODES. '=' maps to 64 and anything else to 0xff.
+		struct Base64DecodeTable
+		{
+			uint8_t value[256] = {};
+
+			constexpr Base64DecodeTable()
+			{
+				for (int i = 0; i < 256; i++)
+					value[i] = 0xff;
+
+				for (uint8_t i = 0; i < 65; i++)
+					value[(uint8_t)BASE64_CODES[i]] = i;
+			}
+		};
+
+		inline constexpr Base64DecodeTable BASE64_DECODE;
+
+		constexpr int hexValue(char c)
+		{
+			return ('0' <= c && c <= '9') ? c - '0'
+				: ('a' <= c && c <= 'f') ? c - 'a' + 10
+				: ('A' <= c && c <= 'F') ? c - 'A' + 10
+				: -1;
+		}
+	}
+
+	constexpr bool isUrlUnreserved(char c)
+	{
+		return ('a' <= c && c <= 'z') ||
+			('A' <= c && c <= 'Z') ||
+			('0' <= c && c <= '9') ||
+			c == '-' || c == '.' || c == '_';
+	}
+
+	constexpr size_t urlEncodedLength(std::string_view url)
+	{
+		size_t required = 0;
+
+		for (char c : url)
+			required += isUrlUnreserved(c) ? 1 : 3;
+
+		return required;
+	}
+
+	template <class Output>
+	constexpr void urlEncode(std::string_view url, Output &out)
+	{
+		SAS_PROFILE_STAGE(UrlEncode);
+
+		for (char c : url)
+		{
+			if (isUrlUnreserved(c))
+			{
+				out.put(c);
+			}
+			else
+			{
+				out.put('%');
+				out.put(HEX_DIGITS[(uint8_t)c >> 4]);
+				out.put(HEX_DIGITS[(uint8_t)c & 15]);
+			}
+		}
+	}
+
+	//
+	// Writes url with its % escapes resolved. Returns false on a bad escape.
+	template <class Output>
+	constexpr bool urlDecode(std::string_view url, Output &out)
+	{
+		for (size_t i = 0; i < url.length(); i++)
+		{
+			if (url[i] != '%')
+			{
+				out.put(url[i]);
+				continue;
+			}
+
+			int hi = (i + 2 < url.length()) ? detail::hexValue(url[i + 1]) : -1;
+			int lo = (hi >= 0) ? detail::hexValue(url[i + 2]) : -1;
+
+			if (lo < 0)
+				return false;
+
+			out.put((char)(hi * 16 + lo));
+			i += 2;
+		}
+
+		return true;
+	}
+
+	constexpr size_t base64EncodedLength(size_t inputLength)
+	{
+		return (inputLength + 2) / 3 * 4;
+	}
+
+	template <class Output>
+	constexpr void encodeBase64(const uint8_t *input, size_t inputLength, Output &out)
+	{
+		size_t i = 0;
+
+		for (; i + 3 <= inputLength; i += 3)
+		{
+			out.put(BASE64_CODES[input[i] >> 2]);
+			out.put(BASE64_CODES[((input[i] & 0x03) << 4) | (input[i + 1] >> 4)]);
+			out.put(BASE64_CODES[((input[i + 1] & 0x0F) << 2) | (input[i + 2] >> 6)]);
+			out.put(BASE64_CODES[input[i + 2] & 0x3F]);
+		}
+
+		if (i + 1 == inputLength)
+		{
+			out.put(BASE64_CODES[input[i] >> 2]);
+			out.put(BASE64_CODES[(input[i] & 0x03) << 4]);
+			out.put('=');
+			out.put('=');
+		}
+		else if (i + 2 == inputLength)
+		{
+			out.put(BASE64_CODES[input[i] >> 2]);
+			out.put(BASE64_CODES[((input[i] & 0x03) << 4) | (input[i + 1] >> 4)]);
+			out.put(BASE64_CODES[(input[i + 1] & 0x0F) << 2]);
+			out.put('=');
+		}
+	}
+
+	//
+	// Decodes from Base64. Returns the decoded length, which is all that is
+	// calculated when output is null or outputLength is 0. Returns -1 if the
+	// input is not valid Base64 and -2 if the output buffer is too short.
+	constexpr ptrdiff_t decodeBase64(std::string_view input, uint8_t *output, size_t outputLength)
+	{
+		if (input.length() % 4 != 0)
+			return -1;    // Base64 string's length must be a multiple of 4
+
+		size_t padding = input.find('=');
+		size_t requiredLen = (input.length() * 3) / 4 - (padding != std::string_view::npos ? (input.length() - padding) : 0);
+
+		if (outputLength == 0 || output == nullptr)
+			return (ptrdiff_t)requiredLen;
+
+		if (requiredLen > outputLength)
+			return -2;    // Output buffer is too short
+
+		size_t j = 0;
+
+		for (size_t i = 0; i < input.length(); i += 4)
+		{
+			uint8_t b[4] = {};
+
+			for (int k = 0; k < 4; k++)
+			{
+				b[k] = detail::BASE64_DECODE.value[(uint8_t)input[i + k]];
+
+				if (b[k] == 0xff || (k < 2 && b[k] == 64))
+					return -1;
+			}
+
+			if (j < requiredLen)
+				output[j++] = (uint8_t)((b[0] << 2) | (b[1] >> 4));
+
+			if (b[2] < 64)
+			{
+				if (j < requiredLen)
+					output[j++] = (uint8_t)((b[1] << 4) | (b[2] >> 2));
+
+				if (b[3] < 64 && j < requiredLen)
+					output[j++] = (uint8_t)((b[2] << 6) | b[3]);
+			}
+		}
+
+		return (ptrdiff_t)requiredLen;
+	}
+}
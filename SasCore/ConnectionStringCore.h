@@ -0,0 +1,336 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <bit>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAS_SCAN_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SAS_SCAN_NEON
+#endif
+
+#include "Profile.h"
+
+/*
+ * Connection string tokenizer. A connection string is a ';' separated list
+ * of keyword=value pairs. Keywords are case insensitive, values are not and
+ * may themselves contain '='.
+ *
+ * The tokenizer does not walk the string a byte at a time. It classifies 64
+ * bytes at once into bitmasks of ';' and '=' positions, using AVX2, SSE2 or
+ * NEON where the build targets them, and then walks the set bits. Only the
+ * first '=' of a pair separates keyword from value. Once inside a value the
+ * '=' bits are skipped, so Base64 padding in keys is part of the value.
+ */
+namespace sas
+{
+	constexpr char toLower(char c)
+	{
+		return ('A' <= c && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+	}
+
+	constexpr bool keywordEquals(std::string_view left, std::string_view right)
+	{
+		if (left.length() != right.length())
+			return false;
+
+		for (size_t i = 0; i < left.length(); i++)
+		{
+			if (toLower(left[i]) != toLower(right[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	constexpr bool keywordLess(std::string_view left, std::string_view right)
+	{
+		size_t length = left.length() < right.length() ? left.length() : right.length();
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char l = toLower(left[i]);
+			char r = toLower(right[i]);
+
+			if (l != r)
+				return (unsigned char)l < (unsigned char)r;
+		}
+
+		return left.length() < right.length();
+	}
+
+	namespace detail
+	{
+		struct DelimiterMasks
+		{
+			uint64_t separators;
+			uint64_t equals;
+		};
+
+		constexpr size_t SCAN_BLOCK = 64;
+
+		constexpr DelimiterMasks scanDelimitersBytes(const char *p, size_t n)
+		{
+			DelimiterMasks masks = { 0, 0 };
+
+			for (size_t i = 0; i < n; i++)
+			{
+				if (p[i] == ';')
+					masks.separators |= (uint64_t)1 << i;
+				else if (p[i] == '=')
+					masks.equals |= (uint64_t)1 << i;
+			}
+
+			return masks;
+		}
+
+		//
+		// Classifies a full SCAN_BLOCK bytes
+		inline DelimiterMasks scanDelimitersBlock(const char *p)
+		{
+#if defined(__AVX2__)
+			const __m256i separator = _mm256_set1_epi8(';');
+			const __m256i equals = _mm256_set1_epi8('=');
+			__m256i lo = _mm256_loadu_si256((const __m256i *)p);
+			__m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+			return DelimiterMasks{
+				(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, separator)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, separator)) << 32),
+				(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, equals)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, equals)) << 32) };
+#elif defined(SAS_SCAN_SSE2)
+			const __m128i separator = _mm_set1_epi8(';');
+			const __m128i equals = _mm_set1_epi8('=');
+			DelimiterMasks masks = { 0, 0 };
+
+			for (int i = 0; i < 4; i++)
+			{
+				__m128i bytes = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+
+				masks.separators |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, separator)) << (16 * i);
+				masks.equals |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, equals)) << (16 * i);
+			}
+
+			return masks;
+#elif defined(SAS_SCAN_NEON)
+			static const uint8_t bitValues[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+			const uint8x16_t bits = vld1q_u8(bitValues);
+			DelimiterMasks masks = { 0, 0 };
+
+			// No movemask on NEON. Keep one bit per matching byte and add
+			// each half across lanes.
+			auto moveMask = [bits](uint8x16_t match) -> uint64_t
+			{
+				uint8x16_t masked = vandq_u8(match, bits);
+
+				return vaddv_u8(vget_low_u8(masked)) | ((uint64_t)vaddv_u8(vget_high_u8(masked)) << 8);
+			};
+
+			for (int i = 0; i < 4; i++)
+			{
+				uint8x16_t bytes = vld1q_u8((const uint8_t *)(p + 16 * i));
+
+				masks.separators |= moveMask(vceqq_u8(bytes, vdupq_n_u8(';'))) << (16 * i);
+				masks.equals |= moveMask(vceqq_u8(bytes, vdupq_n_u8('='))) << (16 * i);
+			}
+
+			return masks;
+#else
+			return scanDelimitersBytes(p, SCAN_BLOCK);
+#endif
+		}
+
+		//
+		// Classifies up to SCAN_BLOCK bytes. A short tail is copied out so the
+		// vector loads stay inside the buffer.
+		constexpr DelimiterMasks scanDelimiters(const char *p, size_t n)
+		{
+			if (std::is_constant_evaluated())
+				return scanDelimitersBytes(p, n);
+
+			if (n == SCAN_BLOCK)
+				return scanDelimitersBlock(p);
+
+			char tail[SCAN_BLOCK] = {};
+
+			memcpy(tail, p, n);
+
+			return scanDelimitersBlock(tail);
+		}
+	}
+
+	//
+	// Calls onToken(keyword, value) for each pair in the connection string. A
+	// trailing ';' is allowed. Returns the number of pairs, or -1 if a pair has
+	// no '=' or onToken returned false.
+	template <class OnToken>
+	constexpr int forEachToken(std::string_view connectionString, OnToken &&onToken)
+	{
+		const size_t length = connectionString.length();
+		int itemCount = 0;
+		size_t keywordStart = 0;
+		size_t eqIndex = std::string_view::npos;
+
+		for (size_t base = 0; base < length; base += detail::SCAN_BLOCK)
+		{
+			size_t blockLength = length - base < detail::SCAN_BLOCK ? length - base : detail::SCAN_BLOCK;
+			detail::DelimiterMasks masks = detail::scanDelimiters(connectionString.data() + base, blockLength);
+
+			for (;;)
+			{
+				if (eqIndex == std::string_view::npos)
+				{
+					// In a keyword, the next delimiter must be its '='
+					uint64_t delimiters = masks.separators | masks.equals;
+
+					if (delimiters == 0)
+						break;
+
+					int bit = std::countr_zero(delimiters);
+
+					if (masks.separators & ((uint64_t)1 << bit))
+						return -1;
+
+					eqIndex = base + bit;
+					masks.equals &= masks.equals - 1;
+				}
+				else
+				{
+					// In a value, only ';' ends it
+					if (masks.separators == 0)
+						break;
+
+					int bit = std::countr_zero(masks.separators);
+					size_t end = base + bit;
+
+					if (!onToken(connectionString.substr(keywordStart, eqIndex - keywordStart), connectionString.substr(eqIndex + 1, end - (eqIndex + 1))))
+						return -1;
+
+					itemCount++;
+					keywordStart = end + 1;
+					eqIndex = std::string_view::npos;
+					masks.separators &= masks.separators - 1;
+					masks.equals &= ~(((uint64_t)2 << bit) - 1);
+				}
+			}
+		}
+
+		if (keywordStart < length)
+		{
+			if (eqIndex == std::string_view::npos)
+				return -1;
+
+			if (!onToken(connectionString.substr(keywordStart, eqIndex - keywordStart), connectionString.substr(eqIndex + 1)))
+				return -1;
+
+			itemCount++;
+		}
+
+		return itemCount;
+	}
+
+	//
+	// Releases what buildKeywordTable allocated. capacity is the length the
+	// arrays were allocated with, tokenCount the number of entries filled in.
+	template <class Allocator>
+	void freeKeywordTable(Allocator &allocator, int tokenCount, char **keywords, char **values, int capacity)
+	{
+		for (int i = 0; i < tokenCount; i++)
+		{
+			if (keywords[i] != nullptr)
+				allocator.deallocate(keywords[i], strlen(keywords[i]) + 1);
+
+			if (values[i] != nullptr)
+				allocator.deallocate(values[i], strlen(values[i]) + 1);
+		}
+
+		if (keywords != nullptr)
+			allocator.deallocate(keywords, sizeof(char *) * capacity);
+
+		if (values != nullptr)
+			allocator.deallocate(values, sizeof(char *) * capacity);
+	}
+
+	//
+	// Builds the keyword and value arrays used by the C handles. Keywords are
+	// stored in lower case. Every string is null terminated and allocated from
+	// allocator. Returns false with nothing left allocated on failure.
+	template <class Allocator>
+	bool buildKeywordTable(std::string_view connectionString, Allocator &allocator, int &tokenCount, char **&keywords, char **&values)
+	{
+		tokenCount = 0;
+		keywords = nullptr;
+		values = nullptr;
+
+		int count = forEachToken(connectionString, [](std::string_view, std::string_view) { return true; });
+
+		if (count <= 0)
+			return false;
+
+		keywords = (char **)allocator.allocate(sizeof(char *) * count);
+		values = (char **)allocator.allocate(sizeof(char *) * count);
+
+		if (keywords == nullptr || values == nullptr)
+		{
+			freeKeywordTable(allocator, 0, keywords, values, count);
+			return false;
+		}
+
+		int stored = 0;
+		auto copy = [&allocator](std::string_view from, bool lower) -> char *
+		{
+			char *to = (char *)allocator.allocate(from.length() + 1);
+
+			if (to != nullptr)
+			{
+				for (size_t i = 0; i < from.length(); i++)
+					to[i] = lower ? toLower(from[i]) : from[i];
+
+				to[from.length()] = '\0';
+			}
+
+			return to;
+		};
+
+		int result = forEachToken(connectionString, [&](std::string_view keyword, std::string_view value)
+		{
+			keywords[stored] = copy(keyword, true);
+			values[stored] = copy(value, false);
+			stored++;
+
+			return keywords[stored - 1] != nullptr && values[stored - 1] != nullptr;
+		});
+
+		if (result != count)
+		{
+			freeKeywordTable(allocator, stored, keywords, values, count);
+			return false;
+		}
+
+		tokenCount = count;
+
+		return true;
+	}
+
+	//
+	// Returns the value for keyword or null if it is not in the table
+	inline const char *findKeywordValue(int tokenCount, char *const *keywords, char *const *values, std::string_view keyword)
+	{
+		SAS_PROFILE_STAGE(KeywordLookup);
+
+		for (int i = 0; i < tokenCount; i++)
+		{
+			if (keywordEquals(keywords[i], keyword))
+				return values[i];
+		}
+
+		return nullptr;
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Sha256Core.h"
+#include "Codec.h"
+#include "ConnectionStringCore.h"
+#include "TokenCore.h"
+
+/*
+ * A device identity worked out entirely by the compiler. For firmware with a
+ * single connection string baked in:
+ *
+ *  static constexpr auto device = sas::compileDevice<"HostName=...;DeviceId=...;SharedAccessKey=...">();
+ *
+ * parses the connection string, decodes the key, URL encodes the resource URI
+ * and runs the HMAC key schedule at compile time. Only the results end up in
+ * the binary, as constant tables. The connection string and key do not, and
+ * neither do the parser or Base64 decoder unless something else uses them.
+ * Minting a token then costs the expiry formatting and the final compressions.
+ *
+ * A connection string that is missing a keyword or has a bad key is a
+ * compile error naming the problem.
+ */
+namespace sas
+{
+	// A string literal usable as a template argument
+	template <size_t N>
+	struct FixedString
+	{
+		char value[N] = {};
+
+		consteval FixedString(const char (&s)[N])
+		{
+			for (size_t i = 0; i < N; i++)
+				value[i] = s[i];
+		}
+
+		constexpr std::string_view view() const { return std::string_view(value, N - 1); }
+	};
+
+	template <size_t HostLength, size_t DeviceLength, size_t UriLength>
+	struct CompiledDevice
+	{
+		char hostName[HostLength + 1];
+		char deviceId[DeviceLength + 1];
+		char uri[UriLength];
+		HmacMidstate key;
+
+		constexpr EncodedResource resource() const { return EncodedResource{ std::string_view(uri, UriLength) }; }
+
+		constexpr TokenSignature sign(int64_t tokenExpiry) const
+		{
+			struct hmacSha256 keyed = {};
+
+			hmacSha256Init(keyed, key);
+
+			return signToken(keyed, resource(), tokenExpiry);
+		}
+
+		//
+		// Same convention as the C interfaces: returns the length including the
+		// null terminator and only writes output if all of it fits
+		constexpr int generatePassword(int64_t tokenExpiry, char *output, int outputLen) const
+		{
+			TokenSignature signature = sign(tokenExpiry);
+			size_t resultLen = tokenLength(resource(), signature) + 1;
+
+			if (output != nullptr && outputLen >= 0 && (size_t)outputLen >= resultLen)
+			{
+				BufferOutput out(output, (size_t)outputLen);
+
+				writeToken(out, resource(), signature);
+				out.put('\0');
+			}
+
+			return (int)resultLen;
+		}
+	};
+
+	namespace detail
+	{
+		// Deliberately not constexpr. Reaching one of these while compiling a
+		// device identity stops the build with the function name in the error.
+		void connectionStringIsMissingHostNameDeviceIdOrSharedAccessKey();
+		void sharedAccessKeyIsNotValidBase64();
+
+		consteval std::string_view requireKeyword(std::string_view connectionString, std::string_view keyword)
+		{
+			std::string_view result;
+			bool found = false;
+
+			int count = forEachToken(connectionString, [&](std::string_view k, std::string_view v)
+			{
+				if (keywordEquals(k, keyword))
+				{
+					result = v;
+					found = true;
+				}
+
+				return true;
+			});
+
+			if (count < 0 || !found)
+				connectionStringIsMissingHostNameDeviceIdOrSharedAccessKey();
+
+			return result;
+		}
+
+		template <size_t N>
+		constexpr void copyString(char (&to)[N], std::string_view from)
+		{
+			for (size_t i = 0; i < from.length(); i++)
+				to[i] = from[i];
+
+			to[from.length()] = '\0';
+		}
+	}
+
+	template <FixedString ConnectionString>
+	consteval auto compileDevice()
+	{
+		constexpr std::string_view connectionString = ConnectionString.view();
+		constexpr std::string_view hostName = detail::requireKeyword(connectionString, "HostName");
+		constexpr std::string_view deviceId = detail::requireKeyword(connectionString, "DeviceId");
+		constexpr std::string_view sharedAccessKey = detail::requireKeyword(connectionString, "SharedAccessKey");
+		constexpr DeviceResource resource{ hostName, deviceId };
+		constexpr ptrdiff_t keyLength = decodeBase64(sharedAccessKey, nullptr, 0);
+
+		if constexpr (keyLength <= 0)
+		{
+			detail::sharedAccessKeyIsNotValidBase64();
+		}
+
+		CompiledDevice<hostName.length(), deviceId.length(), resource.length()> result = {};
+
+		detail::copyString(result.hostName, hostName);
+		detail::copyString(result.deviceId, deviceId);
+
+		BufferOutput uriOut(result.uri, sizeof(result.uri));
+
+		resource.write(uriOut);
+
+		uint8_t key[keyLength > 0 ? keyLength : 1] = {};
+
+		if (decodeBase64(sharedAccessKey, key, sizeof(key)) != keyLength)
+			detail::sharedAccessKeyIsNotValidBase64();
+
+		struct hmacSha256 keyed = {};
+
+		hmacSha256Init(keyed, key, sizeof(key));
+		result.key = hmacSha256Midstate(keyed);
+
+		return result;
+	}
+}
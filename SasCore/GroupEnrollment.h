@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Sha256Core.h"
+#include "Codec.h"
+#include "TokenCore.h"
+
+/*
+ * Device Provisioning Service symmetric key group enrollments. Every device
+ * in the group gets the key
+ *
+ *  Base64(HMAC-SHA256(Base64Decode(groupKey), registrationId))
+ *
+ * The group key is the same for every device so its key schedule is run
+ * once and the keyed state copied per device. A registration id of up to 55
+ * bytes then costs two compressions.
+ */
+namespace sas
+{
+	inline constexpr size_t DEVICE_KEY_LENGTH = base64EncodedLength(SHA256_DIGEST_LENGTH);
+
+	//
+	// Sets up groupKeyed from the Base64 group key. Returns false if the key
+	// is not Base64 or is longer than an HMAC block, which no enrollment key is.
+	constexpr bool initGroupKey(struct hmacSha256 &groupKeyed, std::string_view groupKey)
+	{
+		uint8_t key[SHA256_BLOCK_LENGTH] = {};
+		ptrdiff_t keyLen = decodeBase64(groupKey, key, sizeof(key));
+
+		if (keyLen <= 0)
+			return false;
+
+		hmacSha256Init(groupKeyed, key, (size_t)keyLen);
+
+		return true;
+	}
+
+	constexpr void deriveDeviceKey(const struct hmacSha256 &groupKeyed, std::string_view registrationId, uint8_t deviceKey[SHA256_DIGEST_LENGTH])
+	{
+		struct hmacSha256 ctx = groupKeyed;
+
+		hmacSha256Update(ctx, registrationId.data(), registrationId.length());
+		hmacSha256Sum(ctx, deviceKey);
+	}
+
+	//
+	// Writes "<registrationId> <deviceKey>" for one device. With a host name
+	// it is followed by " <token>", a token for the hub device identity DPS
+	// creates, which has the registration id as its device id.
+	template <class Output>
+	constexpr void writeEnrollment(Output &out, const struct hmacSha256 &groupKeyed, std::string_view registrationId, std::string_view hostName, int64_t tokenExpiry)
+	{
+		uint8_t deviceKey[SHA256_DIGEST_LENGTH] = {};
+
+		deriveDeviceKey(groupKeyed, registrationId, deviceKey);
+
+		writeString(out, registrationId);
+		out.put(' ');
+		encodeBase64(deviceKey, sizeof(deviceKey), out);
+
+		if (!hostName.empty())
+		{
+			struct hmacSha256 keyed = {};
+			DeviceResource resource{ hostName, registrationId };
+
+			hmacSha256Init32(keyed, deviceKey);
+			out.put(' ');
+			writeToken(out, resource, signToken(keyed, resource, tokenExpiry));
+		}
+	}
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Codec.h"
+#include "TokenCore.h"
+
+/*
+ * MQTT 3.1.1 CONNECT packet for an IoT hub device, written straight into the
+ * caller's buffer:
+ *
+ *  0x10 <remaining length>
+ *  "MQTT" level 4, flags user name | password | clean session, keep alive
+ *  client id  <deviceId>
+ *  user name  <hostName>/<deviceId>/?api-version=<MQTT_API_VERSION>
+ *  password   <SAS token>
+ *
+ * Every length is known once the token is signed, so the remaining length is
+ * written first and the token is rendered directly into the password field.
+ * readMqttConnect takes a packet apart again, the way a broker would.
+ */
+namespace sas
+{
+	inline constexpr char MQTT_API_VERSION[] = "2021-04-12";
+	inline constexpr char MQTT_PROTOCOL_NAME[] = "MQTT";
+	inline constexpr uint8_t MQTT_CONNECT = 0x10;
+	inline constexpr uint8_t MQTT_PROTOCOL_LEVEL = 4;
+	inline constexpr uint8_t MQTT_FLAG_USER_NAME = 0x80;
+	inline constexpr uint8_t MQTT_FLAG_PASSWORD = 0x40;
+	inline constexpr uint8_t MQTT_FLAG_CLEAN_SESSION = 0x02;
+	inline constexpr size_t MQTT_MAX_REMAINING_LENGTH = 268435455;
+	inline constexpr size_t MQTT_MAX_STRING_LENGTH = 65535;
+
+	// The identity parts of the packet. The resource and signature come from
+	// the token.
+	struct MqttIdentity
+	{
+		std::string_view hostName;
+		std::string_view deviceId;
+		uint16_t keepAlive = 240;
+	};
+
+	namespace detail
+	{
+		inline constexpr char MQTT_API_QUERY[] = "/?api-version=";
+
+		constexpr size_t mqttUserNameLength(const MqttIdentity &identity)
+		{
+			return identity.hostName.length() + 1 + identity.deviceId.length() + (sizeof(MQTT_API_QUERY) - 1) + (sizeof(MQTT_API_VERSION) - 1);
+		}
+
+		constexpr size_t mqttVarintLength(size_t value)
+		{
+			return value < 128 ? 1 : value < 16384 ? 2 : value < 2097152 ? 3 : 4;
+		}
+
+		template <class Output>
+		constexpr void putMqttLength16(Output &out, size_t length)
+		{
+			out.put((char)(uint8_t)(length >> 8));
+			out.put((char)(uint8_t)length);
+		}
+	}
+
+	//
+	// Bytes after the fixed header. 0 if a field is longer than MQTT allows.
+	template <class Resource>
+	constexpr size_t mqttConnectRemainingLength(const MqttIdentity &identity, const Resource &resource, const TokenSignature &signature)
+	{
+		size_t userNameLength = detail::mqttUserNameLength(identity);
+		size_t passwordLength = tokenLength(resource, signature);
+
+		if (identity.deviceId.length() > MQTT_MAX_STRING_LENGTH || userNameLength > MQTT_MAX_STRING_LENGTH || passwordLength > MQTT_MAX_STRING_LENGTH)
+			return 0;
+
+		return (2 + sizeof(MQTT_PROTOCOL_NAME) - 1) + 1 + 1 + 2 +
+			2 + identity.deviceId.length() +
+			2 + userNameLength +
+			2 + passwordLength;
+	}
+
+	//
+	// Length of the whole packet. 0 if a field is longer than MQTT allows.
+	template <class Resource>
+	constexpr size_t mqttConnectLength(const MqttIdentity &identity, const Resource &resource, const TokenSignature &signature)
+	{
+		size_t remaining = mqttConnectRemainingLength(identity, resource, signature);
+
+		return remaining == 0 ? 0 : 1 + detail::mqttVarintLength(remaining) + remaining;
+	}
+
+	template <class Output, class Resource>
+	constexpr void writeMqttConnect(Output &out, const MqttIdentity &identity, const Resource &resource, const TokenSignature &signature)
+	{
+		size_t remaining = mqttConnectRemainingLength(identity, resource, signature);
+
+		out.put((char)MQTT_CONNECT);
+
+		do
+		{
+			uint8_t digit = (uint8_t)(remaining % 128);
+
+			remaining /= 128;
+			out.put((char)(remaining > 0 ? digit | 0x80 : digit));
+		} while (remaining > 0);
+
+		detail::putMqttLength16(out, sizeof(MQTT_PROTOCOL_NAME) - 1);
+		writeString(out, MQTT_PROTOCOL_NAME);
+		out.put((char)MQTT_PROTOCOL_LEVEL);
+		out.put((char)(MQTT_FLAG_USER_NAME | MQTT_FLAG_PASSWORD | MQTT_FLAG_CLEAN_SESSION));
+		detail::putMqttLength16(out, identity.keepAlive);
+
+		detail::putMqttLength16(out, identity.deviceId.length());
+		writeString(out, identity.deviceId);
+
+		detail::putMqttLength16(out, detail::mqttUserNameLength(identity));
+		writeString(out, identity.hostName);
+		out.put('/');
+		writeString(out, identity.deviceId);
+		writeString(out, detail::MQTT_API_QUERY);
+		writeString(out, MQTT_API_VERSION);
+
+		detail::putMqttLength16(out, tokenLength(resource, signature));
+		writeToken(out, resource, signature);
+	}
+
+	//
+	// Signs a token and writes the CONNECT packet carrying it into buffer.
+	// Returns the packet length and only writes if all of it fits, or -1 if a
+	// field is longer than MQTT allows.
+	template <class Resource>
+	constexpr ptrdiff_t buildMqttConnect(char *buffer, size_t capacity, const MqttIdentity &identity, const struct hmacSha256 &keyed, const Resource &resource, int64_t tokenExpiry)
+	{
+		TokenSignature signature = signToken(keyed, resource, tokenExpiry);
+		size_t length = mqttConnectLength(identity, resource, signature);
+
+		if (length == 0)
+			return -1;
+
+		if (buffer != nullptr && length <= capacity)
+		{
+			BufferOutput out(buffer, capacity);
+
+			writeMqttConnect(out, identity, resource, signature);
+		}
+
+		return (ptrdiff_t)length;
+	}
+
+	// The fields a broker takes from a CONNECT packet, pointing into it
+	struct MqttConnectFields
+	{
+		uint8_t flags = 0;
+		uint16_t keepAlive = 0;
+		std::string_view clientId;
+		std::string_view userName;
+		std::string_view password;
+	};
+
+	//
+	// Parses a complete CONNECT packet. Returns the packet length, 0 if more
+	// bytes are needed or -1 if it is not a valid MQTT 3.1.1 CONNECT. Will
+	// topics and messages are skipped.
+	constexpr ptrdiff_t readMqttConnect(std::string_view packet, MqttConnectFields &fields)
+	{
+		if (packet.empty())
+			return 0;
+
+		if ((uint8_t)packet[0] != MQTT_CONNECT)
+			return -1;
+
+		size_t remaining = 0;
+		size_t i = 1;
+
+		for (int shift = 0; ; shift += 7)
+		{
+			if (i >= packet.length())
+				return 0;
+
+			if (shift > 21)
+				return -1;
+
+			uint8_t digit = (uint8_t)packet[i++];
+
+			remaining |= (size_t)(digit & 0x7f) << shift;
+
+			if ((digit & 0x80) == 0)
+				break;
+		}
+
+		if (packet.length() - i < remaining)
+			return 0;
+
+		std::string_view body = packet.substr(i, remaining);
+		size_t at = 0;
+		bool valid = true;
+
+		auto readString = [&]() -> std::string_view
+		{
+			if (body.length() - at < 2)
+			{
+				valid = false;
+				return {};
+			}
+
+			size_t length = ((size_t)(uint8_t)body[at] << 8) | (uint8_t)body[at + 1];
+
+			if (body.length() - at - 2 < length)
+			{
+				valid = false;
+				return {};
+			}
+
+			at += 2 + length;
+
+			return body.substr(at - length, length);
+		};
+
+		if (readString() != MQTT_PROTOCOL_NAME || body.length() - at < 4 || (uint8_t)body[at] != MQTT_PROTOCOL_LEVEL)
+			return -1;
+
+		fields = MqttConnectFields{};
+		fields.flags = (uint8_t)body[at + 1];
+		fields.keepAlive = (uint16_t)(((uint8_t)body[at + 2] << 8) | (uint8_t)body[at + 3]);
+		at += 4;
+
+		if ((fields.flags & 0x01) != 0 || ((fields.flags & MQTT_FLAG_PASSWORD) != 0 && (fields.flags & MQTT_FLAG_USER_NAME) == 0))
+			return -1;
+
+		fields.clientId = readString();
+
+		if ((fields.flags & 0x04) != 0)
+		{
+			readString();
+			readString();
+		}
+
+		if ((fields.flags & MQTT_FLAG_USER_NAME) != 0)
+			fields.userName = readString();
+
+		if ((fields.flags & MQTT_FLAG_PASSWORD) != 0)
+			fields.password = readString();
+
+		if (!valid || at != body.length())
+			return -1;
+
+		return (ptrdiff_t)(i + remaining);
+	}
+}
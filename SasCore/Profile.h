@@ -0,0 +1,260 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Optional per stage timing of token minting. Build with SAS_PROFILE defined
+ * to have each stage of the hot path count calls and ticks into counters
+ * owned by the calling thread. Without SAS_PROFILE SAS_PROFILE_STAGE expands
+ * to nothing and none of this is compiled.
+ *
+ * Stages nest, a stage's time excludes the stages it calls, so the stage
+ * totals add up to the time spent minting. Ticks are the time stamp counter
+ * on x86 and x64 and nanoseconds elsewhere. ticksPerSecond converts them.
+ *
+ * Calls count entries into a stage, not steps of the algorithm, so calls per
+ * token differ between builds doing the same work differently. The C builds
+ * encode the device URI each time signToken, tokenLength and writeToken walk
+ * it and decode the key on every token. The C++ helper does both once in its
+ * constructor, so they show no calls per token at all. SAS_PROFILE_STAGE_TIME
+ * adds time to a stage without counting an entry, for a part of a step done
+ * away from the rest, like the HMAC key schedule.
+ */
+#ifdef SAS_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SAS_PROFILE_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define SAS_PROFILE_RDTSC
+#elif defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
+namespace sas
+{
+	namespace profile
+	{
+		enum class Stage
+		{
+			KeywordLookup,
+			UriBuild,
+			UrlEncode,
+			KeyDecode,
+			Hmac,
+			SignatureEncode,
+			Format,
+			Count
+		};
+
+		inline constexpr size_t STAGE_COUNT = (size_t)Stage::Count;
+
+		constexpr const char *stageName(Stage stage)
+		{
+			constexpr const char *names[STAGE_COUNT] = { "keyword lookup", "URI build", "URL encode", "key decode", "HMAC", "signature encode", "format" };
+
+			return (size_t)stage < STAGE_COUNT ? names[(size_t)stage] : "unknown";
+		}
+
+		inline uint64_t ticks()
+		{
+#if defined(SAS_PROFILE_RDTSC)
+			return __rdtsc();
+#elif defined(CLOCK_MONOTONIC)
+			struct timespec ts;
+
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		//
+		// Measured once against the steady clock on x86, which takes about
+		// 20ms the first time
+		inline double ticksPerSecond()
+		{
+#if defined(SAS_PROFILE_RDTSC)
+			static const double rate = []
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				uint64_t first = __rdtsc();
+
+				while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20))
+				{
+				}
+
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				return (double)(__rdtsc() - first) / seconds;
+			}();
+
+			return rate;
+#else
+			return 1e9;
+#endif
+		}
+
+		struct StageTotals
+		{
+			uint64_t calls[STAGE_COUNT] = {};
+			uint64_t ticks[STAGE_COUNT] = {};
+		};
+
+		// One thread's counters. Only the owning thread writes them, collect
+		// reads them from any thread. They are linked into a list when first
+		// used and never freed so they survive the thread for collect.
+		struct ThreadCounters
+		{
+			std::atomic<uint64_t> calls[STAGE_COUNT] = {};
+			std::atomic<uint64_t> ticks[STAGE_COUNT] = {};
+			ThreadCounters *next = nullptr;
+		};
+
+		inline std::atomic<ThreadCounters *> &threadList()
+		{
+			static std::atomic<ThreadCounters *> head(nullptr);
+
+			return head;
+		}
+
+		inline ThreadCounters &threadCounters()
+		{
+			static thread_local ThreadCounters *counters = []
+			{
+				ThreadCounters *created = new ThreadCounters;
+
+				created->next = threadList().load(std::memory_order_relaxed);
+
+				while (!threadList().compare_exchange_weak(created->next, created, std::memory_order_release, std::memory_order_relaxed))
+				{
+				}
+
+				return created;
+			}();
+
+			return *counters;
+		}
+
+		// Adds without a locked instruction, the owner is the only writer
+		inline void charge(Stage stage, uint64_t elapsed, uint64_t calls)
+		{
+			ThreadCounters &counters = threadCounters();
+
+			counters.ticks[(size_t)stage].store(counters.ticks[(size_t)stage].load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+			counters.calls[(size_t)stage].store(counters.calls[(size_t)stage].load(std::memory_order_relaxed) + calls, std::memory_order_relaxed);
+		}
+
+		class ScopedStage;
+
+		inline ScopedStage *&currentStage()
+		{
+			static thread_local ScopedStage *current = nullptr;
+
+			return current;
+		}
+
+		// Times a stage from construction to destruction, counting a call
+		// unless counted is false. Does nothing during constant evaluation.
+		class ScopedStage
+		{
+		private:
+			Stage _stage;
+			bool _counted;
+			uint64_t _start = 0;
+			ScopedStage *_parent = nullptr;
+
+			void start()
+			{
+				_parent = currentStage();
+				_start = ticks();
+
+				if (_parent != nullptr)
+				{
+					charge(_parent->_stage, _start - _parent->_start, 0);
+				}
+
+				currentStage() = this;
+			}
+
+			void stop()
+			{
+				uint64_t now = ticks();
+
+				charge(_stage, now - _start, _counted ? 1 : 0);
+
+				if (_parent != nullptr)
+					_parent->_start = now;
+
+				currentStage() = _parent;
+			}
+
+		public:
+			constexpr ScopedStage(Stage stage, bool counted = true) : _stage(stage), _counted(counted)
+			{
+				if (!std::is_constant_evaluated())
+					start();
+			}
+
+			constexpr ~ScopedStage()
+			{
+				if (!std::is_constant_evaluated())
+					stop();
+			}
+
+			ScopedStage(const ScopedStage &) = delete;
+			ScopedStage &operator=(const ScopedStage &) = delete;
+		};
+
+		//
+		// Adds up the counters of every thread that has run a stage
+		inline StageTotals collect()
+		{
+			StageTotals totals;
+
+			for (ThreadCounters *counters = threadList().load(std::memory_order_acquire); counters != nullptr; counters = counters->next)
+			{
+				for (size_t i = 0; i < STAGE_COUNT; i++)
+				{
+					totals.calls[i] += counters->calls[i].load(std::memory_order_relaxed);
+					totals.ticks[i] += counters->ticks[i].load(std::memory_order_relaxed);
+				}
+			}
+
+			return totals;
+		}
+
+		//
+		// Zeroes the calling thread's counters. Other threads' counters are
+		// theirs to write, so reset before starting them or compare collect
+		// results instead.
+		inline void reset()
+		{
+			ThreadCounters &counters = threadCounters();
+
+			for (size_t i = 0; i < STAGE_COUNT; i++)
+			{
+				counters.calls[i].store(0, std::memory_order_relaxed);
+				counters.ticks[i].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+#define SAS_PROFILE_CONCAT2(a, b) a##b
+#define SAS_PROFILE_CONCAT(a, b) SAS_PROFILE_CONCAT2(a, b)
+#define SAS_PROFILE_STAGE(stage) sas::profile::ScopedStage SAS_PROFILE_CONCAT(sasProfileStage, __LINE__)(sas::profile::Stage::stage)
+#define SAS_PROFILE_STAGE_TIME(stage) sas::profile::ScopedStage SAS_PROFILE_CONCAT(sasProfileStage, __LINE__)(sas::profile::Stage::stage, false)
+
+#else
+
+#define SAS_PROFILE_STAGE(stage)
+#define SAS_PROFILE_STAGE_TIME(stage)
+
+#endif
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+
+#include "Sha256Core.h"
+#include "Codec.h"
+#include "TokenCore.h"
+
+/*
+ * Device registry import. An IoT hub bulk export is one JSON object per line:
+ *
+ *  {"id":"dev1","eTag":"...","authentication":{"symmetricKey":{"primaryKey":"...","secondaryKey":"..."},"type":"sas"},...}
+ *
+ * The identities are read straight out of the JSON, there is no detour
+ * through a connection string. The scanner does not build a document. It
+ * reports each string value with the keys leading to it as views into the
+ * line, so nothing is allocated. importRegistry streams lines through a
+ * caller supplied buffer, so memory use is the size of that buffer whatever
+ * the size of the export.
+ */
+namespace sas
+{
+	inline constexpr int JSON_MAX_DEPTH = 16;
+	inline constexpr size_t REGISTRY_ID_LENGTH = 128;	// Longest device id the hub allows
+
+	namespace detail
+	{
+		constexpr size_t skipJsonSpace(std::string_view text, size_t i)
+		{
+			while (i < text.length() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n'))
+				i++;
+
+			return i;
+		}
+
+		//
+		// i is the opening quote. Returns the index after the closing quote or
+		// npos if the string is not terminated.
+		constexpr size_t skipJsonString(std::string_view text, size_t i)
+		{
+			for (i++; i < text.length(); i++)
+			{
+				if (text[i] == '\\')
+					i++;
+				else if (text[i] == '"')
+					return i + 1;
+			}
+
+			return std::string_view::npos;
+		}
+
+		constexpr bool isJsonDelimiter(char c)
+		{
+			return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+		}
+
+		constexpr long readHex4(std::string_view text, size_t i)
+		{
+			if (i + 4 > text.length())
+				return -1;
+
+			long value = 0;
+
+			for (size_t j = i; j < i + 4; j++)
+			{
+				int digit = hexValue(text[j]);
+
+				if (digit < 0)
+					return -1;
+
+				value = value * 16 + digit;
+			}
+
+			return value;
+		}
+	}
+
+	//
+	// Calls onString(keys, depth, raw) for every string value in text. keys[0]
+	// to keys[depth - 1] are the member names leading to the value, empty for
+	// array elements. Names and values are still JSON escaped. Returns false if
+	// text is not a single well formed JSON value. Numbers and literals are
+	// only delimited, not validated.
+	template <class OnString>
+	constexpr bool scanJson(std::string_view text, OnString &&onString)
+	{
+		std::string_view keys[JSON_MAX_DEPTH] = {};
+		bool objects[JSON_MAX_DEPTH] = {};
+		int depth = 0;
+		size_t i = detail::skipJsonSpace(text, 0);
+
+		auto readKey = [&]() -> bool
+		{
+			if (i >= text.length() || text[i] != '"')
+				return false;
+
+			size_t end = detail::skipJsonString(text, i);
+
+			if (end == std::string_view::npos)
+				return false;
+
+			keys[depth - 1] = text.substr(i + 1, end - i - 2);
+			i = detail::skipJsonSpace(text, end);
+
+			if (i >= text.length() || text[i] != ':')
+				return false;
+
+			i = detail::skipJsonSpace(text, i + 1);
+
+			return true;
+		};
+
+		for (;;)
+		{
+			if (i >= text.length())
+				return false;
+
+			char c = text[i];
+
+			if (c == '{' || c == '[')
+			{
+				if (depth == JSON_MAX_DEPTH)
+					return false;
+
+				objects[depth] = (c == '{');
+				keys[depth] = {};
+				depth++;
+				i = detail::skipJsonSpace(text, i + 1);
+
+				if (i < text.length() && text[i] == (c == '{' ? '}' : ']'))
+				{
+					depth--;
+					i++;
+				}
+				else
+				{
+					if (c == '{' && !readKey())
+						return false;
+
+					continue;
+				}
+			}
+			else if (c == '"')
+			{
+				size_t end = detail::skipJsonString(text, i);
+
+				if (end == std::string_view::npos)
+					return false;
+
+				onString(keys, depth, text.substr(i + 1, end - i - 2));
+				i = end;
+			}
+			else
+			{
+				size_t start = i;
+
+				while (i < text.length() && !detail::isJsonDelimiter(text[i]))
+					i++;
+
+				if (i == start)
+					return false;
+			}
+
+			// After a value close any finished containers, then move on to the
+			// next element or member
+			for (;;)
+			{
+				i = detail::skipJsonSpace(text, i);
+
+				if (depth == 0)
+					return i == text.length();
+
+				if (i >= text.length())
+					return false;
+
+				if (text[i] == ',')
+				{
+					i = detail::skipJsonSpace(text, i + 1);
+
+					if (objects[depth - 1] && !readKey())
+						return false;
+
+					break;
+				}
+
+				if (text[i] != (objects[depth - 1] ? '}' : ']'))
+					return false;
+
+				depth--;
+				i++;
+			}
+		}
+	}
+
+	//
+	// Writes a JSON string body with its escapes resolved, \u escapes as
+	// UTF-8. Returns false on a bad escape.
+	template <class Output>
+	constexpr bool jsonUnescape(std::string_view raw, Output &out)
+	{
+		for (size_t i = 0; i < raw.length(); i++)
+		{
+			if (raw[i] != '\\')
+			{
+				out.put(raw[i]);
+				continue;
+			}
+
+			if (++i == raw.length())
+				return false;
+
+			switch (raw[i])
+			{
+			case '"':
+			case '\\':
+			case '/':
+				out.put(raw[i]);
+				break;
+			case 'b': out.put('\b'); break;
+			case 'f': out.put('\f'); break;
+			case 'n': out.put('\n'); break;
+			case 'r': out.put('\r'); break;
+			case 't': out.put('\t'); break;
+			case 'u':
+			{
+				long code = detail::readHex4(raw, i + 1);
+
+				if (code < 0)
+					return false;
+
+				i += 4;
+
+				if (code >= 0xd800 && code < 0xdc00)
+				{
+					long low = (i + 2 < raw.length() && raw[i + 1] == '\\' && raw[i + 2] == 'u') ? detail::readHex4(raw, i + 3) : -1;
+
+					if (low < 0xdc00 || low >= 0xe000)
+						return false;
+
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					i += 6;
+				}
+				else if (code >= 0xdc00 && code < 0xe000)
+				{
+					return false;
+				}
+
+				if (code < 0x80)
+				{
+					out.put((char)code);
+				}
+				else if (code < 0x800)
+				{
+					out.put((char)(0xc0 | (code >> 6)));
+					out.put((char)(0x80 | (code & 0x3f)));
+				}
+				else if (code < 0x10000)
+				{
+					out.put((char)(0xe0 | (code >> 12)));
+					out.put((char)(0x80 | ((code >> 6) & 0x3f)));
+					out.put((char)(0x80 | (code & 0x3f)));
+				}
+				else
+				{
+					out.put((char)(0xf0 | (code >> 18)));
+					out.put((char)(0x80 | ((code >> 12) & 0x3f)));
+					out.put((char)(0x80 | ((code >> 6) & 0x3f)));
+					out.put((char)(0x80 | (code & 0x3f)));
+				}
+
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// The fields of one export line, still JSON escaped and pointing into it
+	struct RegistryDevice
+	{
+		std::string_view deviceId;
+		std::string_view primaryKey;
+	};
+
+	//
+	// Picks the device id and primary symmetric key out of one export line.
+	// The id is "id" in hub exports and "deviceId" in device twins, either
+	// is accepted. Returns false if the line is not JSON or a field is
+	// missing, as it is for devices that authenticate with certificates.
+	constexpr bool parseRegistryLine(std::string_view line, RegistryDevice &device)
+	{
+		device = RegistryDevice{};
+
+		bool parsed = scanJson(line, [&device](const std::string_view *keys, int depth, std::string_view value)
+		{
+			if (depth == 1 && (keys[0] == "id" || keys[0] == "deviceId"))
+				device.deviceId = value;
+			else if (depth == 3 && keys[0] == "authentication" && keys[1] == "symmetricKey" && keys[2] == "primaryKey")
+				device.primaryKey = value;
+		});
+
+		return parsed && !device.deviceId.empty() && !device.primaryKey.empty();
+	}
+
+	// A device from the export ready to sign tokens
+	struct RegistryIdentity
+	{
+		char deviceId[REGISTRY_ID_LENGTH] = {};
+		size_t deviceIdLength = 0;
+		struct hmacSha256 keyed = {};
+
+		constexpr std::string_view id() const { return std::string_view(deviceId, deviceIdLength); }
+		constexpr DeviceResource resource(std::string_view hostName) const { return DeviceResource{ hostName, id() }; }
+	};
+
+	//
+	// Unescapes the id and decodes the key of an export line into identity.
+	// Returns false if either does not fit or the key is not Base64.
+	constexpr bool decodeRegistryDevice(const RegistryDevice &device, RegistryIdentity &identity)
+	{
+		BufferOutput idOut(identity.deviceId, sizeof(identity.deviceId));
+
+		if (!jsonUnescape(device.deviceId, idOut) || idOut.overflowed())
+			return false;
+
+		identity.deviceIdLength = idOut.count();
+
+		// Base64 has no characters JSON must escape but '/' may be written as \/
+		char keyText[base64EncodedLength(SHA256_BLOCK_LENGTH)] = {};
+		BufferOutput keyTextOut(keyText, sizeof(keyText));
+
+		if (!jsonUnescape(device.primaryKey, keyTextOut) || keyTextOut.overflowed())
+			return false;
+
+		uint8_t key[SHA256_BLOCK_LENGTH] = {};
+		ptrdiff_t keyLen = decodeBase64(std::string_view(keyText, keyTextOut.count()), key, sizeof(key));
+
+		if (keyLen <= 0)
+			return false;
+
+		hmacSha256Init(identity.keyed, key, (size_t)keyLen);
+
+		return true;
+	}
+
+	//
+	// Reads through buffer and calls onBlock(std::string_view) with each run of
+	// complete lines in it, newlines included. Only the last line of the input
+	// may be missing its newline. read(char *to, size_t length) returns the
+	// number of bytes read, 0 at the end. A line longer than the buffer is
+	// dropped and counted in the return value.
+	template <class Read, class OnBlock>
+	uint64_t forEachLineBlock(char *buffer, size_t bufferLength, Read &&read, OnBlock &&onBlock)
+	{
+		uint64_t dropped = 0;
+		size_t used = 0;
+		bool discarding = false;
+
+		for (;;)
+		{
+			size_t got = read(buffer + used, bufferLength - used);
+			size_t end = used + got;
+			size_t start = 0;
+
+			if (discarding)
+			{
+				const char *newLine = (const char *)memchr(buffer, '\n', end);
+
+				if (newLine != nullptr)
+				{
+					start = (size_t)(newLine - buffer) + 1;
+					discarding = false;
+				}
+				else
+				{
+					start = end;
+				}
+			}
+
+			size_t blockEnd = end;
+
+			if (got != 0)
+			{
+				while (blockEnd > start && buffer[blockEnd - 1] != '\n')
+					blockEnd--;
+			}
+
+			if (blockEnd > start)
+				onBlock(std::string_view(buffer + start, blockEnd - start));
+
+			if (got == 0)
+				break;
+
+			if (blockEnd == 0 && end == bufferLength && !discarding)
+			{
+				// A line longer than the buffer. Drop it up to its newline.
+				dropped++;
+				discarding = true;
+				blockEnd = end;
+			}
+			else if (discarding)
+			{
+				blockEnd = end;
+			}
+
+			memmove(buffer, buffer + blockEnd, end - blockEnd);
+			used = end - blockEnd;
+		}
+
+		return dropped;
+	}
+
+	//
+	// Calls onLine(std::string_view) for each line in a block from
+	// forEachLineBlock, without the newline
+	template <class OnLine>
+	constexpr void forEachLine(std::string_view block, OnLine &&onLine)
+	{
+		while (!block.empty())
+		{
+			size_t newLine = block.find('\n');
+			size_t length = (newLine == std::string_view::npos) ? block.length() : newLine;
+
+			onLine(block.substr(0, length));
+			block.remove_prefix(length == block.length() ? length : length + 1);
+		}
+	}
+
+	struct RegistryImportStats
+	{
+		uint64_t lines = 0;		// Non blank lines read
+		uint64_t devices = 0;	// Lines onDevice accepted
+		uint64_t skipped = 0;	// Lines that did not parse, were longer than the buffer or onDevice rejected
+	};
+
+	//
+	// Reads an export through buffer and calls onDevice(const RegistryDevice&)
+	// for each line, which returns false to count the line as skipped. Lines
+	// are handed over in place so a line must fit in the buffer.
+	template <class Read, class OnDevice>
+	RegistryImportStats importRegistry(char *buffer, size_t bufferLength, Read &&read, OnDevice &&onDevice)
+	{
+		RegistryImportStats stats;
+
+		uint64_t dropped = forEachLineBlock(buffer, bufferLength, read, [&](std::string_view block)
+		{
+			forEachLine(block, [&](std::string_view line)
+			{
+				if (detail::skipJsonSpace(line, 0) == line.length())
+					return;
+
+				RegistryDevice device;
+
+				stats.lines++;
+
+				if (parseRegistryLine(line, device) && onDevice(device))
+					stats.devices++;
+				else
+					stats.skipped++;
+			});
+		});
+
+		stats.lines += dropped;
+		stats.skipped += dropped;
+
+		return stats;
+	}
+}
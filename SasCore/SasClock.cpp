@@ -0,0 +1,28 @@
+#include "Clock.h"
+#include "SasClock.h"
+
+// Read the system clock
+int64_t sasClockReal(void* context)
+{
+	(void)context;
+
+	return sas::RealClock().now();
+}
+
+// Return the time cached by the last sasClockCoarseRefresh
+int64_t sasClockCoarse(void* context)
+{
+	return ((SASCOARSECLOCK*)context)->now;
+}
+
+// Return a fixed time
+int64_t sasClockFixed(void* context)
+{
+	return *(int64_t*)context;
+}
+
+// Update the cached time. Uses the cheaper coarse clock where one exists.
+void sasClockCoarseRefresh(SASCOARSECLOCK* clock)
+{
+	clock->now = sas::readCoarseClock();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Clocks used to compute SAS token expiry times. A clock returns seconds since
+ * the Unix epoch as a 64 bit value so expiry times survive 2038.
+ *
+ *  sasClockReal      Reads the system clock on every call. context is unused.
+ *  sasClockCoarse    Returns the time cached in the SASCOARSECLOCK pointed to
+ *                    by context. Call sasClockCoarseRefresh once per batch of
+ *                    tokens rather than reading the system clock per token.
+ *  sasClockFixed     Returns the int64_t pointed to by context. Use this for
+ *                    reproducible output in tests and benchmarks.
+ */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef int64_t (*SASCLOCK)(void* context);
+
+typedef struct _SASCOARSECLOCK
+{
+	int64_t now;
+} SASCOARSECLOCK;
+
+int64_t sasClockReal(void* context);
+int64_t sasClockCoarse(void* context);
+int64_t sasClockFixed(void* context);
+void sasClockCoarseRefresh(SASCOARSECLOCK* clock);
+
+#ifdef __cplusplus
+}
+#endif
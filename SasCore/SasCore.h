@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * Header only core shared by the C++, C and NoMalloc builds. The C++ build
+ * uses it directly. The C and NoMalloc builds wrap it in their extern "C"
+ * interfaces, each instantiating it with their own allocator policy.
+ *
+ *  Sha256Core.h            SHA-256 and HMAC-SHA256
+ *  Codec.h                 Output policies, Base64 and URL encoding
+ *  Allocators.h            Allocator policies
+ *  ConnectionStringCore.h  Connection string tokenizer and keyword table
+ *  TokenCore.h             SAS token signing and assembly
+ *  Clock.h                 Clock policies
+ *  DeviceIdentity.h        Device identity compiled from a connection string literal
+ *  RegistryImport.h        JSON scanner and streaming device registry export reader
+ *  GroupEnrollment.h       DPS group enrollment device key derivation
+ *  MqttConnect.h           MQTT CONNECT packet writer and reader
+ *  TokenValidator.h        SAS token parsing and signature checking
+ *  Profile.h               Optional per stage timing, enabled by SAS_PROFILE
+ */
+
+#include "Sha256Core.h"
+#include "Codec.h"
+#include "Allocators.h"
+#include "ConnectionStringCore.h"
+#include "TokenCore.h"
+#include "Clock.h"
+#include "DeviceIdentity.h"
+#include "RegistryImport.h"
+#include "GroupEnrollment.h"
+#include "MqttConnect.h"
+#include "TokenValidator.h"
+#include "Profile.h"
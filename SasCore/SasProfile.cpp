@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "Allocators.h"
+#include "Profile.h"
+#include "SasProfile.h"
+
+// Mint iterations tokens and measure them. Returns -1 if a mint fails.
+int sasProfileRun(SASPROFILEMINT mint, void* context, long iterations, SASPROFILERESULT* result)
+{
+	if (mint == NULL || iterations <= 0 || result == NULL)
+		return -1;
+
+	memset(result, 0, sizeof(*result));
+	result->iterations = iterations;
+	result->tokenLength = mint(context);
+
+	if (result->tokenLength < 0)
+		return -1;
+
+#ifdef SAS_PROFILE
+	sas::profile::reset();
+#endif
+
+	sas::AllocationCounts before = sas::allocationCounts();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (long i = 0; i < iterations; i++)
+	{
+		if (mint(context) < 0)
+			return -1;
+	}
+
+	result->nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	result->allocations = sas::allocationCounts().allocations - before.allocations;
+	result->allocatedBytes = sas::allocationCounts().bytes - before.bytes;
+
+#ifdef SAS_PROFILE
+	sas::profile::StageTotals totals = sas::profile::collect();
+	double nanosecondsPerTick = 1e9 / sas::profile::ticksPerSecond();
+
+	for (size_t i = 0; i < sas::profile::STAGE_COUNT && i < SASPROFILE_MAX_STAGES; i++)
+	{
+		result->stages[i].name = sas::profile::stageName((sas::profile::Stage)i);
+		result->stages[i].calls = totals.calls[i];
+		result->stages[i].nanoseconds = (double)totals.ticks[i] * nanosecondsPerTick;
+		result->stageCount++;
+	}
+#endif
+
+	return 0;
+}
+
+// Print the per token figures
+void sasProfilePrint(const SASPROFILERESULT* result)
+{
+	double n = (double)result->iterations;
+
+	printf("%ld tokens of %d bytes\r\n", result->iterations, result->tokenLength);
+	printf("%-18s %10.1f ns/op\r\n", "total", result->nanoseconds / n);
+	printf("%-18s %10.2f /op\r\n", "allocations", (double)result->allocations / n);
+	printf("%-18s %10.1f bytes/op\r\n", "allocated", (double)result->allocatedBytes / n);
+
+	if (result->stageCount == 0)
+	{
+		printf("Build with SAS_PROFILE defined for the time of each stage\r\n");
+		return;
+	}
+
+	for (int i = 0; i < result->stageCount; i++)
+	{
+		printf("%-18s %10.1f ns/op %8.2f calls/op\r\n", result->stages[i].name,
+			result->stages[i].nanoseconds / n, (double)result->stages[i].calls / n);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Benchmark loop behind the samples' --profile option. sasProfileRun calls
+ * mint iterations times after one warm up call and reports the time taken,
+ * what the shim's allocator handed out and, in a build with SAS_PROFILE
+ * defined, the time spent in each stage (see Profile.h). Everything is
+ * measured on the calling thread.
+ */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SASPROFILE_MAX_STAGES 16
+
+// Mints one token, returns its length without a terminator or -1 on error
+typedef int (*SASPROFILEMINT)(void* context);
+
+typedef struct _SASPROFILESTAGE
+{
+	const char* name;
+	uint64_t calls;
+	double nanoseconds;
+} SASPROFILESTAGE;
+
+typedef struct _SASPROFILERESULT
+{
+	long iterations;
+	int tokenLength;
+	double nanoseconds;
+	uint64_t allocations;
+	uint64_t allocatedBytes;
+	int stageCount;					// 0 without SAS_PROFILE
+	SASPROFILESTAGE stages[SASPROFILE_MAX_STAGES];
+} SASPROFILERESULT;
+
+int sasProfileRun(SASPROFILEMINT mint, void* context, long iterations, SASPROFILERESULT* result);
+void sasProfilePrint(const SASPROFILERESULT* result);
+
+#ifdef __cplusplus
+}
+#endif
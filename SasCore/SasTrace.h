@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * USDT static probes, provider "sas", so a running process can be traced
+ * with bpftrace or perf without a rebuild:
+ *
+ *  mint_start    const char *deviceId, int64_t tokenTTL
+ *  mint_end      const char *deviceId, int64_t tokenTTL, int bytes (< 0 on error)
+ *  cache_hit     const char *deviceId, int64_t tokenTTL
+ *  cache_miss    const char *deviceId, int64_t tokenTTL
+ *  heap_malloc   size_t bytes, void *result, int freeBytes
+ *  heap_free     void *address, int freeBytes
+ *  heap_realloc  void *address, size_t newLength, void *result, int freeBytes
+ *
+ * For example
+ *
+ *  bpftrace -e 'usdt:./IoTSASTokenGenerate_C:sas:mint_end { @bytes[str(arg0)] = hist(arg2); }'
+ *
+ * A probe is a single nop until a tracer attaches. The probes need
+ * sys/sdt.h (systemtap-sdt-dev), without it or with SAS_NO_TRACE defined
+ * they compile to nothing.
+ *
+ * Arguments that cost something to work out are only computed when
+ * SAS_TRACE_ENABLED says a tracer is attached. A file that uses it defines
+ * SAS_TRACE_SEMAPHORES before including this header and then defines the
+ * semaphore of every probe it fires with SAS_TRACE_SEMAPHORE.
+ */
+#if !defined(SAS_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define SAS_HAVE_SDT
+#endif
+#endif
+
+#ifdef SAS_HAVE_SDT
+
+#ifdef SAS_TRACE_SEMAPHORES
+#define _SDT_HAS_SEMAPHORES 1
+#endif
+
+#include <sys/sdt.h>
+
+#define SAS_TRACE2(name, a, b) DTRACE_PROBE2(sas, name, a, b)
+#define SAS_TRACE3(name, a, b, c) DTRACE_PROBE3(sas, name, a, b, c)
+#define SAS_TRACE4(name, a, b, c, d) DTRACE_PROBE4(sas, name, a, b, c, d)
+
+#ifdef SAS_TRACE_SEMAPHORES
+#define SAS_TRACE_SEMAPHORE(name) __attribute__((used, section(".probes"))) volatile unsigned short sas_##name##_semaphore
+#define SAS_TRACE_ENABLED(name) __builtin_expect(sas_##name##_semaphore != 0, 0)
+#endif
+
+#else
+
+#define SAS_TRACE2(name, a, b) ((void)0)
+#define SAS_TRACE3(name, a, b, c) ((void)0)
+#define SAS_TRACE4(name, a, b, c, d) ((void)0)
+
+#endif
+
+#ifndef SAS_TRACE_SEMAPHORE
+#define SAS_TRACE_SEMAPHORE(name) struct sas_##name##_semaphore
+#define SAS_TRACE_ENABLED(name) 0
+#endif
@@ -0,0 +1,323 @@
+/* public domain sha256 implementation based on fips180-3 */
+
+/*
+ * Adapted from code from https://github.com/mikejsavage/hmac
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/*
+ * Header only SHA-256 and HMAC-SHA256 shared by every build. Everything is
+ * constexpr so a key known at compile time can be expanded by the compiler.
+ * The state types are the C structs from sha256.h so the C interface in
+ * sha256.cpp is a straight pass through.
+ */
+namespace sas
+{
+	inline constexpr size_t SHA256_BLOCK_LENGTH = 64;
+
+	inline constexpr uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	namespace detail
+	{
+		constexpr uint32_t ror(uint32_t n, int k) { return (n >> k) | (n << (32 - k)); }
+		constexpr uint32_t Ch(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+		constexpr uint32_t Maj(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); }
+		constexpr uint32_t S0(uint32_t x) { return ror(x, 2) ^ ror(x, 13) ^ ror(x, 22); }
+		constexpr uint32_t S1(uint32_t x) { return ror(x, 6) ^ ror(x, 11) ^ ror(x, 25); }
+		constexpr uint32_t R0(uint32_t x) { return ror(x, 7) ^ ror(x, 18) ^ (x >> 3); }
+		constexpr uint32_t R1(uint32_t x) { return ror(x, 17) ^ ror(x, 19) ^ (x >> 10); }
+
+		// memcpy is not usable in a constant expression
+		template <class Byte>
+		constexpr void copyBytes(uint8_t *dest, const Byte *src, size_t len)
+		{
+			for (size_t i = 0; i < len; i++)
+				dest[i] = (uint8_t)src[i];
+		}
+
+		template <class Byte>
+		constexpr uint32_t loadBigEndian(const Byte *p)
+		{
+			return (uint32_t)(uint8_t)p[0] << 24 | (uint32_t)(uint8_t)p[1] << 16 | (uint32_t)(uint8_t)p[2] << 8 | (uint8_t)p[3];
+		}
+
+		constexpr void storeBigEndian(uint8_t *p, uint32_t value)
+		{
+			p[0] = (uint8_t)(value >> 24);
+			p[1] = (uint8_t)(value >> 16);
+			p[2] = (uint8_t)(value >> 8);
+			p[3] = (uint8_t)value;
+		}
+
+		constexpr void fillBytes(uint8_t *dest, uint8_t value, size_t len)
+		{
+			for (size_t i = 0; i < len; i++)
+				dest[i] = value;
+		}
+	}
+
+	//
+	// Compress one block, already loaded as 16 big endian words, into the hash state h
+	constexpr void sha256Compress(uint32_t h[8], const uint32_t block[16])
+	{
+		using namespace detail;
+
+		uint32_t W[64] = {}, t1 = 0, t2 = 0, a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, hh = 0;
+		int i = 0;
+
+		for (i = 0; i < 16; i++)
+			W[i] = block[i];
+		for (; i < 64; i++)
+			W[i] = R1(W[i-2]) + W[i-7] + R0(W[i-15]) + W[i-16];
+		a = h[0];
+		b = h[1];
+		c = h[2];
+		d = h[3];
+		e = h[4];
+		f = h[5];
+		g = h[6];
+		hh = h[7];
+		for (i = 0; i < 64; i++) {
+			t1 = hh + S1(e) + Ch(e,f,g) + SHA256_K[i] + W[i];
+			t2 = S0(a) + Maj(a,b,c);
+			hh = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += hh;
+	}
+
+	//
+	// Compress one 64 byte block into the hash state h
+	template <class Byte>
+	constexpr void sha256ProcessBlock(uint32_t h[8], const Byte *buf)
+	{
+		uint32_t block[16] = {};
+
+		for (int i = 0; i < 16; i++)
+			block[i] = detail::loadBigEndian(buf + 4 * i);
+
+		sha256Compress(h, block);
+	}
+
+	constexpr void sha256Init(struct sha256 &s)
+	{
+		s.len = 0;
+		s.h[0] = 0x6a09e667;
+		s.h[1] = 0xbb67ae85;
+		s.h[2] = 0x3c6ef372;
+		s.h[3] = 0xa54ff53a;
+		s.h[4] = 0x510e527f;
+		s.h[5] = 0x9b05688c;
+		s.h[6] = 0x1f83d9ab;
+		s.h[7] = 0x5be0cd19;
+	}
+
+	template <class Byte>
+	constexpr void sha256Update(struct sha256 &s, const Byte *p, size_t len)
+	{
+		unsigned r = (unsigned)(s.len % 64);
+
+		s.len += len;
+		if (r) {
+			if (len < 64 - r) {
+				detail::copyBytes(s.buf + r, p, len);
+				return;
+			}
+			detail::copyBytes(s.buf + r, p, 64 - r);
+			len -= 64 - r;
+			p += 64 - r;
+			sha256ProcessBlock(s.h, s.buf);
+		}
+		for (; len >= 64; len -= 64, p += 64)
+			sha256ProcessBlock(s.h, p);
+		detail::copyBytes(s.buf, p, len);
+	}
+
+	//
+	// Pad and compress the final block, leaving the digest as words in s.h
+	constexpr void sha256Finish(struct sha256 &s)
+	{
+		unsigned r = (unsigned)(s.len % 64);
+
+		s.buf[r++] = 0x80;
+		if (r > 56) {
+			detail::fillBytes(s.buf + r, 0, 64 - r);
+			r = 0;
+			sha256ProcessBlock(s.h, s.buf);
+		}
+		detail::fillBytes(s.buf + r, 0, 56 - r);
+		s.len *= 8;
+		for (int i = 0; i < 8; i++)
+			s.buf[56 + i] = (uint8_t)(s.len >> (56 - 8 * i));
+		sha256ProcessBlock(s.h, s.buf);
+	}
+
+	//
+	// The state is ruined after this, keep a copy if the hash is needed again
+	constexpr void sha256Sum(struct sha256 &s, uint8_t md[SHA256_DIGEST_LENGTH])
+	{
+		sha256Finish(s);
+
+		for (int i = 0; i < 8; i++)
+			detail::storeBigEndian(md + 4 * i, s.h[i]);
+	}
+
+	namespace detail
+	{
+		inline constexpr uint32_t INNER_PAD = 0x36363636;
+		inline constexpr uint32_t OUTER_PAD = 0x5c5c5c5c;
+
+		// Each pad is exactly one block so it is compressed directly rather
+		// than going through sha256Update's buffering
+		constexpr void hmacKeyPads(struct hmacSha256 &ctx, const uint32_t key[16])
+		{
+			uint32_t innerBlock[16] = {};
+			uint32_t outerBlock[16] = {};
+
+			for (int i = 0; i < 16; i++) {
+				innerBlock[i] = key[i] ^ INNER_PAD;
+				outerBlock[i] = key[i] ^ OUTER_PAD;
+			}
+
+			sha256Init(ctx.inner);
+			sha256Compress(ctx.inner.h, innerBlock);
+			ctx.inner.len = SHA256_BLOCK_LENGTH;
+			sha256Init(ctx.outer);
+			sha256Compress(ctx.outer.h, outerBlock);
+			ctx.outer.len = SHA256_BLOCK_LENGTH;
+		}
+	}
+
+	//
+	// Key the HMAC with a 32 byte key, the size of every Azure device key.
+	// The key is loaded straight into the pad blocks with no length checks.
+	template <class Byte>
+	constexpr void hmacSha256Init32(struct hmacSha256 &ctx, const Byte *keyInput)
+	{
+		uint32_t key[16] = {};
+
+		for (int i = 0; i < 8; i++)
+			key[i] = detail::loadBigEndian(keyInput + 4 * i);
+
+		detail::hmacKeyPads(ctx, key);
+	}
+
+	//
+	// Key the inner and outer hash states. Keys longer than a block are hashed
+	// first. 32 byte keys take the hmacSha256Init32 path.
+	template <class Byte>
+	constexpr void hmacSha256Init(struct hmacSha256 &ctx, const Byte *keyInput, size_t keyInputLen)
+	{
+		if (keyInputLen == SHA256_DIGEST_LENGTH) {
+			hmacSha256Init32(ctx, keyInput);
+			return;
+		}
+
+		uint8_t keyBytes[SHA256_BLOCK_LENGTH] = {};
+		uint32_t key[16] = {};
+
+		if (keyInputLen <= SHA256_BLOCK_LENGTH) {
+			detail::copyBytes(keyBytes, keyInput, keyInputLen);
+		}
+		else {
+			struct sha256 s = {};
+			sha256Init(s);
+			sha256Update(s, keyInput, keyInputLen);
+			sha256Sum(s, keyBytes);
+		}
+
+		for (int i = 0; i < 16; i++)
+			key[i] = detail::loadBigEndian(keyBytes + 4 * i);
+
+		detail::hmacKeyPads(ctx, key);
+	}
+
+	// The hash states after the inner and outer key pads. This is all a keyed
+	// HMAC needs so it can be computed once, even at compile time, and kept.
+	struct HmacMidstate
+	{
+		uint32_t inner[8];
+		uint32_t outer[8];
+	};
+
+	constexpr HmacMidstate hmacSha256Midstate(const struct hmacSha256 &ctx)
+	{
+		HmacMidstate result = {};
+
+		for (int i = 0; i < 8; i++) {
+			result.inner[i] = ctx.inner.h[i];
+			result.outer[i] = ctx.outer.h[i];
+		}
+
+		return result;
+	}
+
+	//
+	// Key the HMAC from saved midstates, skipping both pad compressions
+	constexpr void hmacSha256Init(struct hmacSha256 &ctx, const HmacMidstate &midstate)
+	{
+		ctx.inner.len = SHA256_BLOCK_LENGTH;
+		ctx.outer.len = SHA256_BLOCK_LENGTH;
+
+		for (int i = 0; i < 8; i++) {
+			ctx.inner.h[i] = midstate.inner[i];
+			ctx.outer.h[i] = midstate.outer[i];
+		}
+	}
+
+	template <class Byte>
+	constexpr void hmacSha256Update(struct hmacSha256 &ctx, const Byte *m, size_t len)
+	{
+		sha256Update(ctx.inner, m, len);
+	}
+
+	//
+	// The outer message is always the 64 byte pad plus a 32 byte digest, so
+	// its final block has a fixed layout. It is built from the inner digest
+	// words and compressed once with no padding bookkeeping.
+	constexpr void hmacSha256Sum(struct hmacSha256 &ctx, uint8_t mac[SHA256_DIGEST_LENGTH])
+	{
+		uint32_t block[16] = {};
+
+		sha256Finish(ctx.inner);
+
+		for (int i = 0; i < 8; i++)
+			block[i] = ctx.inner.h[i];
+
+		block[8] = 0x80000000;
+		block[15] = (uint32_t)(SHA256_BLOCK_LENGTH + SHA256_DIGEST_LENGTH) * 8;
+
+		sha256Compress(ctx.outer.h, block);
+
+		for (int i = 0; i < 8; i++)
+			detail::storeBigEndian(mac + 4 * i, ctx.outer.h[i]);
+	}
+}
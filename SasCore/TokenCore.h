@@ -0,0 +1,427 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Sha256Core.h"
+#include "Codec.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#define SAS_HAVE_IOVEC
+#endif
+
+/*
+ * SAS token assembly. A token is
+ *
+ *  SharedAccessSignature sr=<uri>&sig=<signature>&se=<expiry>
+ *
+ * where uri is the URL encoded resource, expiry is seconds since the Unix epoch
+ * and signature is the URL encoded Base64 HMAC-SHA256 of "<uri>\n<expiry>".
+ * The resource is a template parameter so a build that keeps the encoded URI
+ * and one that encodes it on the fly both get direct code.
+ */
+namespace sas
+{
+	inline constexpr char TOKEN_PREFIX[] = "SharedAccessSignature sr=";
+	inline constexpr char TOKEN_SIGNATURE[] = "&sig=";
+	inline constexpr char TOKEN_EXPIRY[] = "&se=";
+	inline constexpr size_t EXPIRY_LENGTH = 20;   // Longest int64_t in decimal
+
+	//
+	// Writes value in decimal to out, which must have room for EXPIRY_LENGTH
+	// characters. Returns the length. Nothing is null terminated.
+	constexpr size_t formatExpiry(int64_t value, char *out)
+	{
+		char work[EXPIRY_LENGTH] = {};
+		size_t length = 0;
+		uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+		do
+		{
+			work[length++] = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude != 0);
+
+		size_t j = 0;
+
+		if (value < 0)
+			out[j++] = '-';
+
+		while (length > 0)
+			out[j++] = work[--length];
+
+		return j;
+	}
+
+	// The device resource built from the host name and device id. Nothing is
+	// stored, it is URL encoded each time it is written.
+	struct DeviceResource
+	{
+		std::string_view hostName;
+		std::string_view deviceId;
+
+		constexpr size_t length() const
+		{
+			return urlEncodedLength(hostName) + urlEncodedLength("/devices/") + urlEncodedLength(deviceId);
+		}
+
+		template <class Output>
+		constexpr void write(Output &out) const
+		{
+			SAS_PROFILE_STAGE(UriBuild);
+
+			urlEncode(hostName, out);
+			urlEncode("/devices/", out);
+			urlEncode(deviceId, out);
+		}
+	};
+
+	// A resource URI that has already been URL encoded
+	struct EncodedResource
+	{
+		std::string_view encoded;
+
+		constexpr size_t length() const { return encoded.length(); }
+
+		template <class Output>
+		constexpr void write(Output &out) const
+		{
+			SAS_PROFILE_STAGE(UriBuild);
+
+			writeString(out, encoded);
+		}
+	};
+
+	// Output policy that feeds an HMAC. Characters are gathered into a block
+	// sized buffer so the hash sees a few large updates.
+	class HmacOutput
+	{
+	private:
+		struct hmacSha256 &_ctx;
+		uint8_t _buffer[SHA256_BLOCK_LENGTH] = {};
+		size_t _used = 0;
+
+	public:
+		constexpr HmacOutput(struct hmacSha256 &ctx) : _ctx(ctx) {}
+
+		constexpr void put(char c)
+		{
+			_buffer[_used++] = (uint8_t)c;
+
+			if (_used == sizeof(_buffer))
+				flush();
+		}
+
+		constexpr void write(const char *p, size_t len)
+		{
+			for (size_t i = 0; i < len; i++)
+				put(p[i]);
+		}
+
+		constexpr void flush()
+		{
+			hmacSha256Update(_ctx, _buffer, _used);
+			_used = 0;
+		}
+	};
+
+	// The variable parts of a token once it is signed
+	struct TokenSignature
+	{
+		char expiry[EXPIRY_LENGTH] = {};
+		size_t expiryLength = 0;
+		char signature[base64EncodedLength(SHA256_DIGEST_LENGTH)] = {};
+	};
+
+	//
+	// Computes the raw MAC over the resource and expiry with a copy of the
+	// keyed HMAC state
+	template <class Resource>
+	constexpr void macToken(const struct hmacSha256 &keyed, const Resource &resource, int64_t tokenExpiry, uint8_t mac[SHA256_DIGEST_LENGTH])
+	{
+		SAS_PROFILE_STAGE(Hmac);
+
+		struct hmacSha256 ctx = keyed;
+		char expiry[EXPIRY_LENGTH] = {};
+		size_t expiryLength = formatExpiry(tokenExpiry, expiry);
+		HmacOutput hmacOut(ctx);
+
+		resource.write(hmacOut);
+		hmacOut.put('\n');
+		hmacOut.write(expiry, expiryLength);
+		hmacOut.flush();
+		hmacSha256Sum(ctx, mac);
+	}
+
+	//
+	// Formats a MAC and expiry as the variable parts of a token
+	constexpr TokenSignature formatSignature(const uint8_t mac[SHA256_DIGEST_LENGTH], int64_t tokenExpiry)
+	{
+		SAS_PROFILE_STAGE(SignatureEncode);
+
+		TokenSignature result;
+
+		result.expiryLength = formatExpiry(tokenExpiry, result.expiry);
+
+		BufferOutput sigOut(result.signature, sizeof(result.signature));
+
+		encodeBase64(mac, SHA256_DIGEST_LENGTH, sigOut);
+
+		return result;
+	}
+
+	//
+	// Signs the resource and expiry with a copy of the keyed HMAC state
+	template <class Resource>
+	constexpr TokenSignature signToken(const struct hmacSha256 &keyed, const Resource &resource, int64_t tokenExpiry)
+	{
+		uint8_t mac[SHA256_DIGEST_LENGTH] = {};
+
+		macToken(keyed, resource, tokenExpiry, mac);
+
+		return formatSignature(mac, tokenExpiry);
+	}
+
+	template <class Resource>
+	constexpr size_t tokenLength(const Resource &resource, const TokenSignature &signature)
+	{
+		return (sizeof(TOKEN_PREFIX) - 1) + resource.length() +
+			(sizeof(TOKEN_SIGNATURE) - 1) + urlEncodedLength(std::string_view(signature.signature, sizeof(signature.signature))) +
+			(sizeof(TOKEN_EXPIRY) - 1) + signature.expiryLength;
+	}
+
+	template <class Output, class Resource>
+	constexpr void writeToken(Output &out, const Resource &resource, const TokenSignature &signature)
+	{
+		SAS_PROFILE_STAGE(Format);
+
+		writeString(out, TOKEN_PREFIX);
+		resource.write(out);
+		writeString(out, TOKEN_SIGNATURE);
+		urlEncode(std::string_view(signature.signature, sizeof(signature.signature)), out);
+		writeString(out, TOKEN_EXPIRY);
+		out.write(signature.expiry, signature.expiryLength);
+	}
+
+	//
+	// A signed token kept as what actually varies: the raw MAC and expiry,
+	// with a reference to the resource of the identity it belongs to. At 48
+	// bytes it is about a third of the rendered text. The Base64 and URL
+	// encoding happen in renderTo, when the token is sent. The resource must
+	// outlive the token.
+	template <class Resource = EncodedResource>
+	class SasToken
+	{
+	private:
+		const Resource *_resource = nullptr;
+		int64_t _expiry = 0;
+		uint8_t _mac[SHA256_DIGEST_LENGTH] = {};
+
+	public:
+		constexpr SasToken() = default;
+
+		constexpr SasToken(const struct hmacSha256 &keyed, const Resource &resource, int64_t tokenExpiry) : _resource(&resource), _expiry(tokenExpiry)
+		{
+			macToken(keyed, resource, tokenExpiry, _mac);
+		}
+
+		constexpr bool valid() const { return _resource != nullptr; }
+		constexpr const Resource &resource() const { return *_resource; }
+		constexpr int64_t expiry() const { return _expiry; }
+		constexpr const uint8_t *mac() const { return _mac; }
+
+		//
+		// Length of the rendered token, worked out from the MAC bits without
+		// encoding it. Base64 of a digest is 43 characters and one '=', and
+		// only '+', '/' and '=' grow when URL encoded.
+		constexpr size_t size() const
+		{
+			if (_resource == nullptr)
+				return 0;
+
+			char expiry[EXPIRY_LENGTH] = {};
+			size_t signatureLength = urlEncodedLength("=");
+
+			for (size_t bit = 0; bit < SHA256_DIGEST_LENGTH * 8; bit += 6)
+			{
+				size_t i = bit / 8;
+				unsigned window = ((unsigned)_mac[i] << 8) | (i + 1 < SHA256_DIGEST_LENGTH ? _mac[i + 1] : 0);
+				unsigned sextet = (window >> (10 - bit % 8)) & 0x3f;
+
+				signatureLength += (sextet >= 62) ? 3 : 1;
+			}
+
+			return (sizeof(TOKEN_PREFIX) - 1) + _resource->length() +
+				(sizeof(TOKEN_SIGNATURE) - 1) + signatureLength +
+				(sizeof(TOKEN_EXPIRY) - 1) + formatExpiry(_expiry, expiry);
+		}
+
+		template <class Output>
+		constexpr void render(Output &out) const
+		{
+			if (_resource != nullptr)
+				writeToken(out, *_resource, formatSignature(_mac, _expiry));
+		}
+
+		//
+		// Writes the token text to out, which must have room for size()
+		// characters. Nothing is null terminated. Returns the length.
+		constexpr size_t renderTo(char *out) const
+		{
+			size_t length = size();
+			BufferOutput o(out, length);
+
+			render(o);
+
+			return length;
+		}
+	};
+
+	static_assert(sizeof(SasToken<>) <= 48, "SasToken should stay within 48 bytes");
+
+	inline constexpr size_t TOKEN_SEGMENT_COUNT = 3;
+	inline constexpr size_t TOKEN_TAIL_LENGTH = (sizeof(TOKEN_SIGNATURE) - 1) + 3 * base64EncodedLength(SHA256_DIGEST_LENGTH) +
+		(sizeof(TOKEN_EXPIRY) - 1) + EXPIRY_LENGTH;
+
+	struct TokenSegment
+	{
+		const char *data;
+		size_t length;
+	};
+
+	//
+	// A token as the pieces it is made of, for writev, sendmsg or any other
+	// gather write. The prefix is a constant and the URI points at the
+	// identity's encoded resource. Only the "&sig=...&se=..." tail is written,
+	// into scratch space in this object, so it can not be copied and the
+	// resource must outlive it. A token that is not valid() has no segments.
+	class TokenSegments
+	{
+	private:
+		char _tail[TOKEN_TAIL_LENGTH] = {};
+		TokenSegment _segments[TOKEN_SEGMENT_COUNT] = {};
+		size_t _count = 0;
+
+		constexpr void build(const EncodedResource &resource, const TokenSignature &signature)
+		{
+			BufferOutput tail(_tail, sizeof(_tail));
+
+			writeString(tail, TOKEN_SIGNATURE);
+			urlEncode(std::string_view(signature.signature, sizeof(signature.signature)), tail);
+			writeString(tail, TOKEN_EXPIRY);
+			tail.write(signature.expiry, signature.expiryLength);
+
+			_segments[0] = TokenSegment{ TOKEN_PREFIX, sizeof(TOKEN_PREFIX) - 1 };
+			_segments[1] = TokenSegment{ resource.encoded.data(), resource.encoded.length() };
+			_segments[2] = TokenSegment{ _tail, tail.count() };
+			_count = TOKEN_SEGMENT_COUNT;
+		}
+
+	public:
+		constexpr TokenSegments(const EncodedResource &resource, const TokenSignature &signature)
+		{
+			build(resource, signature);
+		}
+
+		constexpr TokenSegments(const SasToken<EncodedResource> &token)
+		{
+			if (token.valid())
+				build(token.resource(), formatSignature(token.mac(), token.expiry()));
+		}
+
+		TokenSegments(const TokenSegments &) = delete;
+		TokenSegments &operator=(const TokenSegments &) = delete;
+
+		// TOKEN_SEGMENT_COUNT, or zero for a token that was not valid
+		constexpr size_t size() const { return _count; }
+		constexpr const TokenSegment &operator[](size_t i) const { return _segments[i]; }
+		constexpr const TokenSegment *begin() const { return _segments; }
+		constexpr const TokenSegment *end() const { return _segments + _count; }
+
+		// Total length of the token
+		constexpr size_t length() const
+		{
+			return _segments[0].length + _segments[1].length + _segments[2].length;
+		}
+
+#ifdef SAS_HAVE_IOVEC
+		//
+		// Fills size() entries of vec, which may be part of a larger vector
+		// holding the rest of a packet. Returns the count.
+		size_t toIovec(struct iovec *vec) const
+		{
+			for (size_t i = 0; i < _count; i++)
+			{
+				vec[i].iov_base = (void *)_segments[i].data;
+				vec[i].iov_len = _segments[i].length;
+			}
+
+			return _count;
+		}
+#endif
+	};
+
+	//
+	// Mints a token the way the C interfaces report it: returns the length
+	// including the null terminator and only writes output if all of it fits.
+	// The key is decoded into a stack buffer, only keys longer than an HMAC
+	// block are decoded into memory from allocator. Returns -1 on error.
+	template <class Allocator>
+	int mintPassword(Allocator &allocator, const char *hostName, const char *deviceId, const char *sharedAccessKey, int64_t tokenExpiry, char *output, int outputLen)
+	{
+		if (hostName == nullptr || deviceId == nullptr || sharedAccessKey == nullptr)
+			return -1;
+
+		uint8_t keyBuffer[SHA256_BLOCK_LENGTH];
+		uint8_t *key = nullptr;
+		ptrdiff_t keyLen;
+		bool decoded = false;
+
+		{
+			SAS_PROFILE_STAGE(KeyDecode);
+
+			keyLen = decodeBase64(sharedAccessKey, nullptr, 0);
+
+			if (keyLen > 0)
+				key = ((size_t)keyLen <= sizeof(keyBuffer)) ? keyBuffer : (uint8_t *)allocator.allocate((size_t)keyLen);
+
+			if (key != nullptr)
+				decoded = decodeBase64(sharedAccessKey, key, (size_t)keyLen) == keyLen;
+		}
+
+		if (key == nullptr)
+			return -1;
+
+		struct hmacSha256 keyed;
+
+		// The call is counted by macToken, this is the key schedule part
+		if (decoded)
+		{
+			SAS_PROFILE_STAGE_TIME(Hmac);
+
+			hmacSha256Init(keyed, key, (size_t)keyLen);
+		}
+
+		if (key != keyBuffer)
+			allocator.deallocate(key, (size_t)keyLen);
+
+		if (!decoded)
+			return -1;
+
+		DeviceResource resource{ hostName, deviceId };
+		TokenSignature signature = signToken(keyed, resource, tokenExpiry);
+		size_t resultLen = tokenLength(resource, signature) + 1;
+
+		if (output != nullptr && outputLen >= 0 && (size_t)outputLen >= resultLen)
+		{
+			BufferOutput out(output, (size_t)outputLen);
+
+			writeToken(out, resource, signature);
+			out.put('\0');
+		}
+
+		return (int)resultLen;
+	}
+}
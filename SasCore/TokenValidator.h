@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "Sha256Core.h"
+#include "Codec.h"
+#include "TokenCore.h"
+
+/*
+ * SAS token checking, the hub's side of TokenCore.h. parseToken splits a
+ * token into its fields without copying. verifyToken recomputes the
+ * signature from a device's HMAC midstate, so checking a token costs the
+ * same two or three compressions as minting one, and compares it in
+ * constant time. Finding the device for a resource is up to the caller.
+ */
+namespace sas
+{
+	inline constexpr char TOKEN_SCHEME[] = "SharedAccessSignature ";
+
+	enum class TokenStatus
+	{
+		Valid,
+		Malformed,		// Not a SharedAccessSignature or a field is missing or bad
+		UnknownDevice,	// No key for the resource
+		BadSignature,
+		Expired
+	};
+
+	constexpr const char *tokenStatusName(TokenStatus status)
+	{
+		switch (status)
+		{
+		case TokenStatus::Valid: return "valid";
+		case TokenStatus::Malformed: return "malformed";
+		case TokenStatus::UnknownDevice: return "unknown device";
+		case TokenStatus::BadSignature: return "bad signature";
+		case TokenStatus::Expired: return "expired";
+		}
+
+		return "unknown";
+	}
+
+	// The fields of a token, still URL encoded and pointing into it
+	struct ParsedToken
+	{
+		std::string_view resource;
+		std::string_view signature;
+		std::string_view expiry;
+		std::string_view keyName;
+	};
+
+	//
+	// Splits "SharedAccessSignature sr=...&sig=...&se=...[&skn=...]" with the
+	// fields in any order. Returns false if sr, sig or se is missing or a
+	// field is repeated or unknown.
+	constexpr bool parseToken(std::string_view token, ParsedToken &parsed)
+	{
+		parsed = ParsedToken{};
+
+		if (token.substr(0, sizeof(TOKEN_SCHEME) - 1) != TOKEN_SCHEME)
+			return false;
+
+		token.remove_prefix(sizeof(TOKEN_SCHEME) - 1);
+
+		while (!token.empty())
+		{
+			size_t end = token.find('&');
+			std::string_view field = token.substr(0, end);
+			size_t eq = field.find('=');
+
+			if (eq == std::string_view::npos)
+				return false;
+
+			std::string_view name = field.substr(0, eq);
+			std::string_view *slot = (name == "sr") ? &parsed.resource
+				: (name == "sig") ? &parsed.signature
+				: (name == "se") ? &parsed.expiry
+				: (name == "skn") ? &parsed.keyName
+				: nullptr;
+
+			if (slot == nullptr || slot->data() != nullptr)
+				return false;
+
+			*slot = field.substr(eq + 1);
+			token.remove_prefix(end == std::string_view::npos ? token.length() : end + 1);
+		}
+
+		return !parsed.resource.empty() && !parsed.signature.empty() && !parsed.expiry.empty();
+	}
+
+	//
+	// Reads a decimal expiry. Returns false if it is not a plain non negative
+	// number that fits in 63 bits.
+	constexpr bool parseExpiry(std::string_view text, int64_t &expiry)
+	{
+		if (text.empty() || text.length() >= EXPIRY_LENGTH)
+			return false;
+
+		uint64_t value = 0;
+
+		for (char c : text)
+		{
+			if (c < '0' || c > '9')
+				return false;
+
+			value = value * 10 + (uint64_t)(c - '0');
+		}
+
+		if (value > (uint64_t)INT64_MAX)
+			return false;
+
+		expiry = (int64_t)value;
+
+		return true;
+	}
+
+	//
+	// Compares without stopping at the first difference, so the time taken
+	// does not say how much of a forged signature was right
+	constexpr bool constantTimeEquals(const uint8_t *left, const uint8_t *right, size_t length)
+	{
+		uint8_t difference = 0;
+
+		for (size_t i = 0; i < length; i++)
+			difference |= (uint8_t)(left[i] ^ right[i]);
+
+		return difference == 0;
+	}
+
+	//
+	// Checks the signature of a parsed token against the device's keyed HMAC
+	// state, then its expiry against now. The signature covers the resource
+	// as it appears in the token, so it is hashed without decoding.
+	constexpr TokenStatus verifyToken(const ParsedToken &parsed, const HmacMidstate &key, int64_t now)
+	{
+		int64_t expiry = 0;
+		char signatureText[base64EncodedLength(SHA256_DIGEST_LENGTH)] = {};
+		BufferOutput signatureOut(signatureText, sizeof(signatureText));
+		uint8_t signature[SHA256_DIGEST_LENGTH] = {};
+
+		if (!parseExpiry(parsed.expiry, expiry) ||
+			!urlDecode(parsed.signature, signatureOut) ||
+			signatureOut.overflowed() ||
+			decodeBase64(std::string_view(signatureText, signatureOut.count()), signature, sizeof(signature)) != (ptrdiff_t)sizeof(signature))
+			return TokenStatus::Malformed;
+
+		struct hmacSha256 ctx = {};
+		uint8_t mac[SHA256_DIGEST_LENGTH] = {};
+
+		hmacSha256Init(ctx, key);
+		hmacSha256Update(ctx, parsed.resource.data(), parsed.resource.length());
+		hmacSha256Update(ctx, "\n", 1);
+		hmacSha256Update(ctx, parsed.expiry.data(), parsed.expiry.length());
+		hmacSha256Sum(ctx, mac);
+
+		if (!constantTimeEquals(mac, signature, sizeof(mac)))
+			return TokenStatus::BadSignature;
+
+		return (expiry <= now) ? TokenStatus::Expired : TokenStatus::Valid;
+	}
+}
@@ -0,0 +1,61 @@
+/* public domain sha256 implementation based on fips180-3 */
+
+/*
+ * C interface to Sha256Core.h for the C and NoMalloc builds
+ */
+
+#include "Sha256Core.h"
+
+void
+sha256Init(void *ctx)
+{
+	sas::sha256Init(*(struct sha256 *)ctx);
+}
+
+void
+sha256Update(void *ctx, const void *m, unsigned long len)
+{
+	sas::sha256Update(*(struct sha256 *)ctx, (const uint8_t *)m, len);
+}
+
+void
+sha256Sum(void *ctx, uint8_t md[SHA256_DIGEST_LENGTH])
+{
+	sas::sha256Sum(*(struct sha256 *)ctx, md);
+}
+
+void
+hmacSha256Init(struct hmacSha256 *ctx, const uint8_t *key, size_t keyLen)
+{
+	sas::hmacSha256Init(*ctx, key, keyLen);
+}
+
+void
+hmacSha256Update(struct hmacSha256 *ctx, const void *m, size_t len)
+{
+	sas::hmacSha256Update(*ctx, (const uint8_t *)m, len);
+}
+
+void
+hmacSha256Sum(struct hmacSha256 *ctx, uint8_t mac[SHA256_DIGEST_LENGTH])
+{
+	sas::hmacSha256Sum(*ctx, mac);
+}
+
+int generateHash(uint8_t *hashedDataOut, uint8_t *data, size_t dataLen, uint8_t *keyInput, size_t keyInputLen)
+{
+	if (hashedDataOut == NULL ||
+		data == NULL ||
+		keyInput == NULL ||
+		dataLen == 1 ||
+		keyInputLen == 0)
+		return -1;
+
+	struct hmacSha256 hmac;
+
+	sas::hmacSha256Init(hmac, keyInput, keyInputLen);
+	sas::hmacSha256Update(hmac, data, dataLen);
+	sas::hmacSha256Sum(hmac, hashedDataOut);
+
+	return 0;
+}
@@ -6,20 +6,30 @@
  
 #pragma once
 
+/*
+ * C interface to the SHA-256 and HMAC-SHA256 implementation in Sha256Core.h.
+ * C++ code should use the sas:: templates directly.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-#include "stdint.h"
-
 struct sha256 {
 	uint64_t len;    /* processed message length */
 	uint32_t h[8];   /* hash state */
 	uint8_t buf[64]; /* message block buffer */
 };
 
+struct hmacSha256 {
+	struct sha256 inner; /* hash state keyed with the inner pad */
+	struct sha256 outer; /* hash state keyed with the outer pad */
+};
+
 enum { SHA256_DIGEST_LENGTH = 32 };
 
 /* reset state */
@@ -30,6 +40,11 @@ void sha256Update(void *ctx, const void *m, unsigned long len);
 /* state is ruined after sum, keep a copy if multiple sum is needed */
 /* part of the message might be left in s, zero it if secrecy is needed */
 void sha256Sum(void *ctx, uint8_t md[SHA256_DIGEST_LENGTH]);
+/* keyed HMAC-SHA256 for messages that are not contiguous in memory */
+/* a keyed context can be copied and reused for several messages */
+void hmacSha256Init(struct hmacSha256 *ctx, const uint8_t *key, size_t keyLen);
+void hmacSha256Update(struct hmacSha256 *ctx, const void *m, size_t len);
+void hmacSha256Sum(struct hmacSha256 *ctx, uint8_t mac[SHA256_DIGEST_LENGTH]);
   /* Wraps up all of the hash generation logic in a C++ accessible function 
    *  
    *  hashedDataOut:    Hashed data will be copied here. This must be SHA256_DIGEST_LENGTH or memory corruption will occur 